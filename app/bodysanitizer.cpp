@@ -0,0 +1,338 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "bodysanitizer.h"
+
+// Qt
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+namespace BodySanitizer
+{
+
+// Deeper nesting of allowed tags is dropped: QTextDocument layout time grows
+// quickly with it
+static const int MAX_NESTING_DEPTH = 8;
+
+enum TagId {
+    TagB,
+    TagI,
+    TagU,
+    TagA,
+    TagCount,
+    // Not closed
+    TagImg,
+    TagBr,
+    // Removed
+    TagWrapper,
+    TagUnknown
+};
+
+static TagId tagIdForName(const QString& name)
+{
+    const QString lower = name.toLower();
+    if (lower == "b") {
+        return TagB;
+    } else if (lower == "i") {
+        return TagI;
+    } else if (lower == "u") {
+        return TagU;
+    } else if (lower == "a") {
+        return TagA;
+    } else if (lower == "img") {
+        return TagImg;
+    } else if (lower == "br") {
+        return TagBr;
+    } else if (lower == "qt" || lower == "html" || lower == "body") {
+        return TagWrapper;
+    }
+    return TagUnknown;
+}
+
+static void appendEscaped(QString* out, const QString& text)
+{
+    for (int idx = 0; idx < text.length(); ++idx) {
+        const QChar ch = text.at(idx);
+        if (ch == '<') {
+            out->append("&lt;");
+        } else if (ch == '>') {
+            out->append("&gt;");
+        } else if (ch == '&') {
+            out->append("&amp;");
+        } else if (ch == '"') {
+            out->append("&quot;");
+        } else {
+            out->append(ch);
+        }
+    }
+}
+
+static bool isHexDigit(QChar ch)
+{
+    const ushort value = ch.unicode();
+    return (value >= '0' && value <= '9')
+        || (value >= 'a' && value <= 'f')
+        || (value >= 'A' && value <= 'F');
+}
+
+/**
+ * Reads the attributes of a tag, starting at @p pos, which must be after the
+ * tag name. Stores the values of @p name1 and @p name2, if not null, in
+ * @p value1 and @p value2. Returns the position of the closing '>', or -1 if
+ * it is not found within MAX_TAG_LENGTH chars.
+ */
+static int parseAttributes(const QString& text, int pos, const char* name1, QString* value1, const char* name2, QString* value2)
+{
+    const int length = qMin(text.length(), pos + MAX_TAG_LENGTH);
+    while (pos < length) {
+        const QChar ch = text.at(pos);
+        if (ch == '>') {
+            return pos;
+        }
+        if (ch.isSpace() || ch == '/') {
+            ++pos;
+            continue;
+        }
+        // Name
+        const int nameStart = pos;
+        while (pos < length && !text.at(pos).isSpace() && text.at(pos) != '=' && text.at(pos) != '>') {
+            ++pos;
+        }
+        const QString name = text.mid(nameStart, pos - nameStart).toLower();
+        while (pos < length && text.at(pos).isSpace()) {
+            ++pos;
+        }
+        if (pos >= length || text.at(pos) != '=') {
+            continue;
+        }
+        ++pos;
+        while (pos < length && text.at(pos).isSpace()) {
+            ++pos;
+        }
+        // Value
+        QString value;
+        if (pos < length && (text.at(pos) == '"' || text.at(pos) == '\'')) {
+            const QChar quote = text.at(pos);
+            // Do not look for the closing quote past the end of the tag:
+            // unterminated values would make us scan the whole body
+            int end = pos + 1;
+            while (end < length && text.at(end) != quote) {
+                ++end;
+            }
+            if (end >= length) {
+                return -1;
+            }
+            value = text.mid(pos + 1, end - pos - 1);
+            pos = end + 1;
+        } else {
+            const int valueStart = pos;
+            while (pos < length && !text.at(pos).isSpace() && text.at(pos) != '>') {
+                ++pos;
+            }
+            value = text.mid(valueStart, pos - valueStart);
+        }
+        if (name1 && name == name1) {
+            *value1 = value;
+        } else if (name2 && name == name2) {
+            *value2 = value;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the length of the entity starting at @p pos (on the '&'), or 0 if
+ * there is no valid entity there
+ */
+static int entityLength(const QString& text, int pos)
+{
+    const int length = text.length();
+    int idx = pos + 1;
+    if (idx < length && text.at(idx) == '#') {
+        ++idx;
+        const bool hex = idx < length && (text.at(idx) == 'x' || text.at(idx) == 'X');
+        if (hex) {
+            ++idx;
+        }
+        const int start = idx;
+        while (idx < length && (hex ? isHexDigit(text.at(idx)) : text.at(idx).isDigit())) {
+            ++idx;
+        }
+        if (idx == start) {
+            return 0;
+        }
+    } else {
+        const int start = idx;
+        while (idx < length && text.at(idx).isLetterOrNumber() && text.at(idx).unicode() < 128) {
+            ++idx;
+        }
+        if (idx == start) {
+            return 0;
+        }
+    }
+    if (idx < length && text.at(idx) == ';') {
+        return idx - pos + 1;
+    }
+    return 0;
+}
+
+QString sanitize(const QString& body)
+{
+    if (body.isEmpty()) {
+        return QString();
+    }
+    static const char* const tagNames[TagCount] = { "b", "i", "u", "a" };
+
+    QString out;
+    out.reserve(body.length() + 16);
+    out.append("<div>");
+
+    // The open allowed tags, innermost last
+    TagId openTags[MAX_NESTING_DEPTH];
+    int depth = 0;
+    // Opening tags which have been dropped because they were too deep: their
+    // closing tags must be dropped as well
+    int droppedCounts[TagCount] = { 0, 0, 0, 0 };
+
+    const int length = body.length();
+    for (int pos = 0; pos < length; ++pos) {
+        const QChar ch = body.at(pos);
+        if (ch == '\n') {
+            out.append("<br>");
+            continue;
+        }
+        if (ch == '\r') {
+            continue;
+        }
+        if (ch == '>') {
+            out.append("&gt;");
+            continue;
+        }
+        if (ch == '&') {
+            const int entity = entityLength(body, pos);
+            if (entity) {
+                out.append(body.midRef(pos, entity));
+                pos += entity - 1;
+            } else {
+                out.append("&amp;");
+            }
+            continue;
+        }
+        if (ch != '<') {
+            out.append(ch);
+            continue;
+        }
+
+        // Tag
+        int idx = pos + 1;
+        const bool closing = idx < length && body.at(idx) == '/';
+        if (closing) {
+            ++idx;
+        }
+        const int nameStart = idx;
+        while (idx < length && body.at(idx).isLetterOrNumber()) {
+            ++idx;
+        }
+        const TagId tag = tagIdForName(body.mid(nameStart, idx - nameStart));
+        QString value1, value2;
+        int end = -1;
+        if (tag != TagUnknown) {
+            if (tag == TagA) {
+                end = parseAttributes(body, idx, "href", &value1, 0, 0);
+            } else if (tag == TagImg) {
+                end = parseAttributes(body, idx, "src", &value1, "alt", &value2);
+            } else {
+                end = parseAttributes(body, idx, 0, 0, 0, 0);
+            }
+        }
+        if (end == -1) {
+            // Unknown or unterminated tag: show it as text
+            out.append("&lt;");
+            continue;
+        }
+        pos = end;
+
+        if (tag == TagWrapper) {
+            continue;
+        }
+        if (tag == TagBr) {
+            out.append("<br>");
+            continue;
+        }
+        if (tag == TagImg) {
+            if (!closing) {
+                out.append("<img src=\"");
+                appendEscaped(&out, value1);
+                out.append("\" alt=\"");
+                appendEscaped(&out, value2);
+                out.append("\">");
+            }
+            continue;
+        }
+        if (closing) {
+            if (droppedCounts[tag] > 0) {
+                --droppedCounts[tag];
+                continue;
+            }
+            // Close the tag and the ones opened after it
+            int openIdx = depth - 1;
+            while (openIdx >= 0 && openTags[openIdx] != tag) {
+                --openIdx;
+            }
+            if (openIdx < 0) {
+                // Not open, drop it
+                continue;
+            }
+            for (; depth > openIdx; --depth) {
+                out.append("</").append(tagNames[openTags[depth - 1]]).append('>');
+            }
+            continue;
+        }
+        if (depth == MAX_NESTING_DEPTH) {
+            ++droppedCounts[tag];
+            continue;
+        }
+        openTags[depth++] = tag;
+        if (tag == TagA) {
+            out.append("<a href=\"");
+            appendEscaped(&out, value1);
+            out.append("\">");
+        } else {
+            out.append('<').append(tagNames[tag]).append('>');
+        }
+    }
+
+    // Balance the allowed tags
+    for (; depth > 0; --depth) {
+        out.append("</").append(tagNames[openTags[depth - 1]]).append('>');
+    }
+    out.append("</div>");
+    return out;
+}
+
+} // namespace
+
+} // namespace
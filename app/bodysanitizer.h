@@ -0,0 +1,65 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef BODYSANITIZER_H
+#define BODYSANITIZER_H
+
+// Qt
+#include <QString>
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+/**
+ * Turns notification bodies into the markup we hand to QTextDocument.
+ */
+namespace BodySanitizer
+{
+
+/**
+ * Longer tags are escaped. This bounds the time spent looking for the end of
+ * unterminated tags.
+ */
+static const int MAX_TAG_LENGTH = 1024;
+
+/**
+ * Sanitizes @p body in a single pass:
+ *
+ * - &lt;qt&gt;, &lt;html&gt; and &lt;body&gt; wrappers are removed
+ * - newlines are converted to &lt;br&gt;
+ * - the tags allowed by the spec (b, i, u, a, img) are kept, without the
+ *   attributes we do not use. Their nesting depth is limited and they are
+ *   balanced.
+ * - other tags, stray '&lt;', '&gt;' and '&amp;' are escaped
+ *
+ * The result is wrapped in a &lt;div&gt; so that concatenated bodies stay in
+ * separate paragraphs. Returns an empty string if @p body is empty.
+ */
+QString sanitize(const QString& body);
+
+} // namespace
+
+} // namespace
+
+#endif /* BODYSANITIZER_H */
@@ -53,13 +53,20 @@ void HLayout::update()
 {
     qreal width = 0;
     qreal height = 0; 
+    bool hasVisibleItems = false;
     Q_FOREACH(QGraphicsWidget* item, mItems) {
+        if (!item->isVisible()) {
+            continue;
+        }
         item->setPos(width, 0);
         QSizeF size = item->size();
         width += size.width() + mSpacing;
         height = qMax(height, size.height());
+        hasVisibleItems = true;
+    }
+    if (hasVisibleItems) {
+        width -= mSpacing; // Remove trailing spacing
     }
-    width -= mSpacing; // Remove trailing spacing
     mParent->setGeometry(0, 0, width, height);
 }
 
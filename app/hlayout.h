@@ -31,7 +31,7 @@ class QGraphicsWidget;
 
 /**
  * A layout-like class which aligns children horizontally and resizes its parent 
- * to fit the children
+ * to fit the children. Hidden children are skipped.
  */
 class HLayout
 {
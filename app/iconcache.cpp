@@ -0,0 +1,140 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "iconcache.h"
+
+
+// KDE
+#include <KIconLoader>
+#include <KUrl>
+
+// Local
+#include <notification.h>
+
+namespace Colibri
+{
+
+// Resolving image paths is cheap compared to loading images, no need for an
+// LRU there: just start over when there are too many of them
+static const int MAX_RESOLVED_PATH_COUNT = 256;
+
+static QString imageFileKey(const QString& path, uint modificationTime)
+{
+    // Include the modification time in the key, so that an image which has
+    // been updated on disk is not served from the cache
+    return "path:" + path + ':' + QString::number(modificationTime);
+}
+
+static int pixmapCost(const QPixmap& pixmap)
+{
+    return qMax(1, pixmap.width() * pixmap.height() * pixmap.depth() / 8);
+}
+
+IconCache::IconCache()
+{
+}
+
+void IconCache::setMaxSize(int kiloBytes)
+{
+    mCache.setMaxCost(kiloBytes * 1024);
+}
+
+QPixmap IconCache::find(const QString& key) const
+{
+    QPixmap* pixmap = mCache.object(key);
+    return pixmap ? *pixmap : QPixmap();
+}
+
+void IconCache::insert(const QString& key, const QPixmap& pixmap)
+{
+    if (pixmap.isNull()) {
+        return;
+    }
+    mCache.insert(key, new QPixmap(pixmap), pixmapCost(pixmap));
+}
+
+QPixmap IconCache::appIconPixmap(const QString& appIcon)
+{
+    if (appIcon.isEmpty()) {
+        return QPixmap();
+    }
+    const QString key = "icon:" + appIcon;
+    QPixmap pixmap = find(key);
+    if (!pixmap.isNull()) {
+        return pixmap;
+    }
+    pixmap = KIconLoader::global()->loadIcon(appIcon, KIconLoader::Panel,
+        ICON_SIZE,
+        KIconLoader::DefaultState,
+        QStringList() /* overlays */,
+        0L /* path_store */,
+        true /* canReturnNull */);
+    insert(key, pixmap);
+    return pixmap;
+}
+
+QString IconCache::findImageForSpecImagePath(const QString& imagePath)
+{
+    QHash<QString, QString>::ConstIterator it = mPathForImagePath.constFind(imagePath);
+    if (it != mPathForImagePath.constEnd()) {
+        return it.value();
+    }
+    QString path = imagePath;
+    if (path.startsWith("file:")) {
+        KUrl url(path);
+        path = url.toLocalFile();
+    }
+    path = KIconLoader::global()->iconPath(path, -KIconLoader::SizeHuge,
+                                           true /* canReturnNull */);
+    if (path.isEmpty()) {
+        // Do not remember failures, the image may show up later
+        return path;
+    }
+    if (mPathForImagePath.size() >= MAX_RESOLVED_PATH_COUNT) {
+        mPathForImagePath.clear();
+    }
+    mPathForImagePath.insert(imagePath, path);
+    return path;
+}
+
+uint IconCache::cachedModificationTime(const QString& path) const
+{
+    return mModificationTimeForPath.value(path);
+}
+
+QPixmap IconCache::findImageFile(const QString& path, uint modificationTime) const
+{
+    return find(imageFileKey(path, modificationTime));
+}
+
+void IconCache::insertImageFile(const QString& path, uint modificationTime, const QPixmap& pixmap)
+{
+    if (pixmap.isNull()) {
+        return;
+    }
+    insert(imageFileKey(path, modificationTime), pixmap);
+    if (mModificationTimeForPath.size() >= MAX_RESOLVED_PATH_COUNT) {
+        mModificationTimeForPath.clear();
+    }
+    mModificationTimeForPath.insert(path, modificationTime);
+}
+
+} // namespace
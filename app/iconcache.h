@@ -0,0 +1,86 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef ICONCACHE_H
+#define ICONCACHE_H
+
+// Qt
+#include <QCache>
+#include <QHash>
+#include <QPixmap>
+#include <QString>
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+/**
+ * An LRU cache of notification icons, already scaled to ICON_SIZE.
+ *
+ * Icons are indexed by a string key: the icon name for app icons, the path
+ * and modification time for image files and a hash of the pixels for
+ * image_data hints. The cache is bounded by the memory used by the pixmaps.
+ */
+class IconCache
+{
+public:
+    IconCache();
+
+    void setMaxSize(int kiloBytes);
+
+    QPixmap find(const QString& key) const;
+
+    void insert(const QString& key, const QPixmap& pixmap);
+
+    /**
+     * Returns the pixmap for the app_icon parameter of a notification
+     */
+    QPixmap appIconPixmap(const QString& appIcon);
+
+    /**
+     * Returns the image file for an image_path hint. The hint can be a path,
+     * an url or an icon name.
+     */
+    QString findImageForSpecImagePath(const QString& imagePath);
+
+    /**
+     * Returns the modification time of the cached version of the image file
+     * @p path, or 0 if it is not cached
+     */
+    uint cachedModificationTime(const QString& path) const;
+
+    QPixmap findImageFile(const QString& path, uint modificationTime) const;
+
+    void insertImageFile(const QString& path, uint modificationTime, const QPixmap& pixmap);
+
+private:
+    QCache<QString, QPixmap> mCache;
+    // Maps image_path hints to files
+    QHash<QString, QString> mPathForImagePath;
+    // Modification time of the cached image files
+    QHash<QString, uint> mModificationTimeForPath;
+};
+
+} // namespace
+
+#endif /* ICONCACHE_H */
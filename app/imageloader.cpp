@@ -0,0 +1,128 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "imageloader.moc"
+
+// Qt
+#include <QDateTime>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QtConcurrentRun>
+
+// KDE
+#include <KDebug>
+
+// Local
+#include <iconcache.h>
+#include <notification.h>
+
+namespace Colibri
+{
+
+struct ImageLoadResult
+{
+    ImageLoadResult()
+    : id(0)
+    , modificationTime(0)
+    , upToDate(false)
+    {}
+
+    uint id;
+    QString path;
+    uint modificationTime;
+    // True if the cached version is still valid, in which case image has not
+    // been loaded
+    bool upToDate;
+    QImage image;
+};
+
+typedef QFutureWatcher<ImageLoadResult> ImageLoadWatcher;
+
+// Runs in a worker thread: must not touch anything but its arguments
+static ImageLoadResult loadImage(uint id, const QString& path, uint cachedModificationTime)
+{
+    ImageLoadResult result;
+    result.id = id;
+    result.path = path;
+    result.modificationTime = QFileInfo(path).lastModified().toTime_t();
+    if (cachedModificationTime != 0 && result.modificationTime == cachedModificationTime) {
+        result.upToDate = true;
+        return result;
+    }
+    QImage image(path);
+    if (qMax(image.width(), image.height()) > ICON_SIZE) {
+        image = image.scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    result.image = image;
+    return result;
+}
+
+ImageLoader::ImageLoader(IconCache* cache, QObject* parent)
+: QObject(parent)
+, mCache(cache)
+{
+}
+
+void ImageLoader::load(uint id, const QString& imagePath)
+{
+    const QString path = mCache->findImageForSpecImagePath(imagePath);
+    if (path.isEmpty()) {
+        // Go through the event loop so that callers always get the signal
+        // after load() returned
+        QMetaObject::invokeMethod(this, "loaded", Qt::QueuedConnection,
+            Q_ARG(uint, id), Q_ARG(QPixmap, QPixmap()));
+        return;
+    }
+    startLoading(id, path, mCache->cachedModificationTime(path));
+}
+
+void ImageLoader::startLoading(uint id, const QString& path, uint cachedModificationTime)
+{
+    ImageLoadWatcher* watcher = new ImageLoadWatcher(this);
+    connect(watcher, SIGNAL(finished()), SLOT(slotFinished()));
+    watcher->setFuture(QtConcurrent::run(loadImage, id, path, cachedModificationTime));
+}
+
+void ImageLoader::slotFinished()
+{
+    ImageLoadWatcher* watcher = static_cast<ImageLoadWatcher*>(sender());
+    const ImageLoadResult result = watcher->result();
+    watcher->deleteLater();
+
+    QPixmap pixmap;
+    if (result.upToDate) {
+        pixmap = mCache->findImageFile(result.path, result.modificationTime);
+        if (pixmap.isNull()) {
+            // Evicted from the cache while we were checking it: load it again
+            startLoading(result.id, result.path, 0);
+            return;
+        }
+    } else if (result.image.isNull()) {
+        kWarning() << "Could not load" << result.path;
+    } else {
+        pixmap = QPixmap::fromImage(result.image);
+        mCache->insertImageFile(result.path, result.modificationTime, pixmap);
+    }
+    loaded(result.id, pixmap);
+}
+
+} // namespace
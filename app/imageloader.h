@@ -0,0 +1,71 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+// Qt
+#include <QObject>
+#include <QPixmap>
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+class IconCache;
+
+/**
+ * Loads the images of image_path hints in a worker thread, so that slow
+ * file systems do not block the GUI or the D-Bus replies.
+ */
+class ImageLoader : public QObject
+{
+    Q_OBJECT
+public:
+    ImageLoader(IconCache* cache, QObject* parent = 0);
+
+    /**
+     * Starts loading the image for notification @p id. loaded() is emitted
+     * when done.
+     */
+    void load(uint id, const QString& imagePath);
+
+Q_SIGNALS:
+    /**
+     * Emitted when the image for notification @p id has been loaded.
+     * @p pixmap is null if the image could not be loaded.
+     */
+    void loaded(uint id, const QPixmap& pixmap);
+
+private Q_SLOTS:
+    void slotFinished();
+
+private:
+    IconCache* mCache;
+
+    void startLoading(uint id, const QString& path, uint cachedModificationTime);
+};
+
+} // namespace
+
+#endif /* IMAGELOADER_H */
@@ -0,0 +1,137 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "latencystats.h"
+
+// libc
+#include <math.h>
+
+// Qt
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+// Buckets per octave
+static const int BUCKET_RESOLUTION = 4;
+
+// Covers up to 2^32 microseconds, more than an hour
+static const int BUCKET_COUNT = 32 * BUCKET_RESOLUTION;
+
+static int bucketForDuration(qint64 duration)
+{
+    if (duration <= 1) {
+        return 0;
+    }
+    const int bucket = int(log2(double(duration)) * BUCKET_RESOLUTION) + 1;
+    return qMin(bucket, BUCKET_COUNT - 1);
+}
+
+static qint64 upperBoundForBucket(int bucket)
+{
+    if (bucket == 0) {
+        return 1;
+    }
+    return qint64(pow(2., double(bucket) / BUCKET_RESOLUTION));
+}
+
+LatencyStats::Histogram::Histogram()
+: mCounts(BUCKET_COUNT, 0)
+, mCount(0)
+, mMax(0)
+{
+}
+
+void LatencyStats::Histogram::addSample(qint64 duration)
+{
+    ++mCounts[bucketForDuration(duration)];
+    ++mCount;
+    mMax = qMax(mMax, duration);
+}
+
+qint64 LatencyStats::Histogram::percentile(int percent) const
+{
+    if (mCount == 0) {
+        return 0;
+    }
+    // Rank of the sample we are looking for, rounded up
+    const int rank = (mCount * percent + 99) / 100;
+    int count = 0;
+    for (int bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        count += mCounts.at(bucket);
+        if (count >= rank) {
+            return qMin(upperBoundForBucket(bucket), mMax);
+        }
+    }
+    return mMax;
+}
+
+LatencyStats::LatencyStats()
+{
+    mClock.start();
+}
+
+qint64 LatencyStats::now() const
+{
+    return mClock.nsecsElapsed() / 1000;
+}
+
+void LatencyStats::addSample(Stage stage, qint64 duration)
+{
+    mHistograms[stage].addSample(duration);
+}
+
+void LatencyStats::reset()
+{
+    for (int stage = 0; stage < StageCount; ++stage) {
+        mHistograms[stage] = Histogram();
+    }
+}
+
+QString LatencyStats::toString() const
+{
+    static const char* const names[StageCount] = {
+        "decode", "queue", "setup", "fade-in", "total"
+    };
+    QString text = QString("%1 %2 %3 %4 %5 %6\n")
+        .arg("stage", -8)
+        .arg("count", 8)
+        .arg("p50", 10)
+        .arg("p95", 10)
+        .arg("p99", 10)
+        .arg("max", 10);
+    for (int stage = 0; stage < StageCount; ++stage) {
+        const Histogram& histogram = mHistograms[stage];
+        text += QString("%1 %2 %3 %4 %5 %6\n")
+            .arg(names[stage], -8)
+            .arg(histogram.mCount, 8)
+            .arg(histogram.percentile(50) / 1000., 10, 'f', 3)
+            .arg(histogram.percentile(95) / 1000., 10, 'f', 3)
+            .arg(histogram.percentile(99) / 1000., 10, 'f', 3)
+            .arg(histogram.mMax / 1000., 10, 'f', 3);
+    }
+    return text;
+}
+
+} // namespace
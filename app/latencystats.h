@@ -0,0 +1,99 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+// Qt
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+/**
+ * Collects how long notifications spend in each stage between the Notify()
+ * call and the bubble being fully visible, as histograms.
+ *
+ * Buckets are a quarter of an octave wide, so percentiles are accurate to
+ * about 20%.
+ */
+class LatencyStats
+{
+public:
+    enum Stage {
+        // Notify() call to notification queued: waiting for the event loop,
+        // markup, image decoding
+        DecodeStage,
+        // Queued to dequeued: waiting for a free bubble or an image
+        QueueStage,
+        // Dequeued to shown: icon lookup, widget setup, window mapping
+        SetupStage,
+        // Shown to fully visible: fade in
+        FadeInStage,
+        // Notify() call to fully visible
+        TotalStage,
+        StageCount
+    };
+
+    LatencyStats();
+
+    /**
+     * Current time in microseconds, on a monotonic clock
+     */
+    qint64 now() const;
+
+    void addSample(Stage, qint64 duration);
+
+    /**
+     * Forgets all samples
+     */
+    void reset();
+
+    /**
+     * A human-readable table of count, p50, p95, p99 and max per stage, in
+     * milliseconds
+     */
+    QString toString() const;
+
+private:
+    struct Histogram
+    {
+        Histogram();
+        void addSample(qint64 duration);
+        qint64 percentile(int percent) const;
+
+        QVector<int> mCounts;
+        int mCount;
+        qint64 mMax;
+    };
+
+    QElapsedTimer mClock;
+    Histogram mHistograms[StageCount];
+};
+
+} // namespace
+
+#endif /* LATENCYSTATS_H */
@@ -38,12 +38,16 @@ int main(int argc, char **argv)
 
     KCmdLineOptions options;
     options.add("single", ki18n("Quit after one popup. Only useful when running with Valgrind"));
+    options.add("stats", ki18n("Collect latency statistics, print them on exit"));
     KCmdLineArgs::addCmdLineOptions(options);
     KCmdLineArgs* args = KCmdLineArgs::parsedArgs();
 
     KApplication app;
     app.setQuitOnLastWindowClosed(args->isSet("single"));
     Colibri::NotificationManager manager;
+    if (args->isSet("stats")) {
+        manager.enableStatistics();
+    }
     if (!manager.connectOnDBus()) {
         return 1;
     }
@@ -0,0 +1,103 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef NOTIFICATION_H
+#define NOTIFICATION_H
+
+// Qt
+#include <QPixmap>
+#include <QString>
+
+// KDE
+#include <KIconLoader>
+
+// Local
+
+namespace Colibri
+{
+
+static const uint CLOSE_REASON_EXPIRED        = 1;
+static const uint CLOSE_REASON_CLOSED_BY_USER = 2;
+static const uint CLOSE_REASON_CLOSED_BY_APP  = 3;
+static const uint CLOSE_REASON_UNDEFINED      = 4;
+
+// Values of the "urgency" hint
+static const int URGENCY_LOW      = 0;
+static const int URGENCY_NORMAL   = 1;
+static const int URGENCY_CRITICAL = 2;
+static const int URGENCY_COUNT    = 3;
+
+static const int ICON_SIZE = KIconLoader::SizeMedium;
+
+/**
+ * The content of a notification. This is what NotificationManager keeps in
+ * its queue: a NotificationWidget is only created when a notification is
+ * about to be shown.
+ */
+struct Notification
+{
+    Notification()
+    : id(0)
+    , bodyTruncated(false)
+    , imagePending(false)
+    , timeout(0)
+    , neverExpires(false)
+    , urgency(URGENCY_NORMAL)
+    , collapsedCount(0)
+    , foldedCount(0)
+    , receivedTime(0)
+    , queuedTime(0)
+    , shownTime(0)
+    {}
+
+    uint id;
+    QString appName;
+    QString appIcon;
+    QString summary;
+    QString body;
+    // True if the body has been truncated because it was too long. Further
+    // appends are ignored.
+    bool bodyTruncated;
+    // Image from the hints. If null, the widget uses appIcon.
+    QPixmap pixmap;
+    // True while the image is being loaded by ImageLoader
+    bool imagePending;
+    // How long the notification is shown, in milliseconds. Ignored if
+    // neverExpires is set.
+    int timeout;
+    // Set when the app asked for a notification which stays until it is
+    // closed with CloseNotification()
+    bool neverExpires;
+    int urgency;
+    // For "N more from <app>" summaries: the number of notifications this one
+    // replaces. 0 for regular notifications.
+    int collapsedCount;
+    // Number of notifications folded into this one by rate limiting
+    int foldedCount;
+
+    // Timestamps for LatencyStats, only set if statistics are enabled
+    qint64 receivedTime;
+    qint64 queuedTime;
+    qint64 shownTime;
+};
+
+} // namespace
+
+#endif /* NOTIFICATION_H */
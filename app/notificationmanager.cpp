@@ -21,48 +21,105 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 // Self
 #include "notificationmanager.moc"
 
+// libc
+#include <stdio.h>
+
 // Qt
+#include <QApplication>
+#include <QCryptographicHash>
 #include <QDBusConnection>
+#include <QDBusMetaType>
+#include <QTimer>
 
 // KDE
 #include <KAboutData>
 #include <KCmdLineArgs>
 #include <KDebug>
-#include <KIconLoader>
-#include <KUrl>
+#include <KLocale>
 
 // Local
+#include <bodysanitizer.h>
+#include <colibriadaptor.h>
 #include <config.h>
+#include <iconcache.h>
+#include <imageloader.h>
+#include <latencystats.h>
 #include <notificationsadaptor.h>
+#include <notificationtext.h>
 #include <notificationwidget.h>
+#include <pixelconversion.h>
 
 namespace Colibri
 {
 
-static QString cleanBody(const QString& _body)
-{
-    QString body = _body;
-    if (body.startsWith("<qt>", Qt::CaseInsensitive)) {
-        body = body.mid(4);
-    } else if (body.startsWith("<html>", Qt::CaseInsensitive)) {
-        body = body.mid(6);
-    }
-    if (body.endsWith("</qt>", Qt::CaseInsensitive)) {
-        body.chop(5);
-    } else if (body.endsWith("</html>", Qt::CaseInsensitive)) {
-        body.chop(6);
-    }
-    if (body.isEmpty()) {
-        return QString();
-    }
-    return "<div>" + body + "</div>";
-}
+// How long we wait for an image_path hint to be loaded before showing the
+// notification with its app icon
+static const int IMAGE_LOAD_DEADLINE = 250;
+
+// Apps which have not sent notifications recently do not need a token
+// bucket. Forget about them when there are more buckets than this.
+static const int MAX_TOKEN_BUCKETS = 256;
+
+// Number of recent notifications per app new notifications are compared to
+static const int FINGERPRINT_WINDOW = 8;
+
+// Forget about the fingerprints of apps with no notification left when there
+// are fingerprints for more apps than this
+static const int MAX_FINGERPRINT_APPS = 256;
+
+// Notify() calls are processed synchronously when more requests than this are
+// waiting to be processed: their hints can be large
+static const int MAX_PENDING_REQUESTS = 256;
+
+// Same thing for requests with image hints, which can be several megabytes
+// each
+static const int MAX_PENDING_IMAGES = 16;
+
+// Number of merged request ids we remember per notification. Older ones are
+// reported as closed.
+static const int MAX_ALIASES_PER_ID = 16;
+
+// Vertical space between stacked notifications
+static const int BUBBLE_SPACING = 6;
 
 NotificationManager::NotificationManager()
 : mNextId(1)
 , mConfig(new Config)
+, mIconCache(new IconCache)
+, mImageLoader(new ImageLoader(mIconCache, this))
+, mStats(0)
+, mQueuedBytes(0)
+, mImageDeadlineTimer(new QTimer(this))
+, mImageDeadlineId(0)
+, mProcessTimer(new QTimer(this))
+, mPendingImageCount(0)
 {
+    mIconCache->setMaxSize(mConfig->iconCacheSize());
+
+    connect(mImageLoader, SIGNAL(loaded(uint, const QPixmap&)),
+        SLOT(slotImageLoaded(uint, const QPixmap&)));
+
+    mProcessTimer->setSingleShot(true);
+    mProcessTimer->setInterval(0);
+    connect(mProcessTimer, SIGNAL(timeout()),
+        SLOT(processPendingRequests()));
+
+    mImageDeadlineTimer->setSingleShot(true);
+    mImageDeadlineTimer->setInterval(IMAGE_LOAD_DEADLINE);
+    connect(mImageDeadlineTimer, SIGNAL(timeout()),
+        SLOT(showNextNotification()));
     new NotificationsAdaptor(this);
+    qDBusRegisterMetaType<NotificationRequest>();
+    qDBusRegisterMetaType<NotificationRequestList>();
+    new ColibriAdaptor(this);
+    mClock.start();
+}
+
+void NotificationManager::enableStatistics()
+{
+    if (!mStats) {
+        mStats = new LatencyStats;
+    }
 }
 
 bool NotificationManager::connectOnDBus()
@@ -85,37 +142,22 @@ bool NotificationManager::connectOnDBus()
 
 NotificationManager::~NotificationManager()
 {
-    delete mConfig;
-}
-
-inline void copyLineRGB32(QRgb* dst, const char* src, int width)
-{
-    const char* end = src + width * 3;
-    for (; src != end; ++dst, src+=3) {
-        *dst = qRgb(src[0], src[1], src[2]);
-    }
-}
-
-inline void copyLineARGB32(QRgb* dst, const char* src, int width)
-{
-    const char* end = src + width * 4;
-    for (; src != end; ++dst, src+=4) {
-        *dst = qRgba(src[0], src[1], src[2], src[3]);
+    qDeleteAll(mVisibleWidgets);
+    qDeleteAll(mWidgetPool);
+    if (mStats) {
+        fprintf(stderr, "%s", qPrintable(mStats->toString()));
+        delete mStats;
     }
+    delete mIconCache;
+    delete mConfig;
 }
 
-static QImage decodeNotificationSpecImageHint(const QDBusArgument& arg)
+/**
+ * Decodes the content of an image_data hint. The returned image may directly
+ * use @p pixels, so it must not outlive them.
+ */
+static QImage decodeNotificationSpecImageHint(int width, int height, int rowStride, int hasAlpha, int bitsPerSample, int channels, const QByteArray& pixels)
 {
-    int width, height, rowStride, hasAlpha, bitsPerSample, channels;
-    QByteArray pixels;
-    char* ptr;
-    char* end;
-
-    arg.beginStructure();
-    arg >> width >> height >> rowStride >> hasAlpha >> bitsPerSample >> channels >> pixels;
-    arg.endStructure();
-    //kDebug() << width << height << rowStride << hasAlpha << bitsPerSample << channels;
-
     #define SANITY_CHECK(condition) \
     if (!(condition)) { \
         kWarning() << "Sanity check failed on" << #condition; \
@@ -131,14 +173,14 @@ static QImage decodeNotificationSpecImageHint(const QDBusArgument& arg)
     #undef SANITY_CHECK
 
     QImage::Format format = QImage::Format_Invalid;
-    void (*fcn)(QRgb*, const char*, int) = 0;
+    PixelConversion::ConvertFunction fcn = 0;
     if (bitsPerSample == 8) {
         if (channels == 4) {
-            format = QImage::Format_ARGB32;
-            fcn = copyLineARGB32;
+            format = QImage::Format_ARGB32_Premultiplied;
+            fcn = PixelConversion::rgbaToPremultipliedArgb;
         } else if (channels == 3) {
             format = QImage::Format_RGB32;
-            fcn = copyLineRGB32;
+            fcn = PixelConversion::rgbToXrgb;
         }
     }
     if (format == QImage::Format_Invalid) {
@@ -146,29 +188,70 @@ static QImage decodeNotificationSpecImageHint(const QDBusArgument& arg)
         return QImage();
     }
 
+    const uchar* ptr = reinterpret_cast<const uchar*>(pixels.constData());
+    const int lineLength = channels * width;
+    int lineCount = height;
+    if (pixels.length() < qint64(rowStride) * (height - 1) + lineLength) {
+        lineCount = pixels.length() < lineLength ? 0 : (pixels.length() - lineLength) / rowStride + 1;
+        kWarning() << "Image data is incomplete. lines:" << lineCount << "height:" << height;
+    }
+
+    if (qMax(width, height) > ICON_SIZE) {
+        // Only ICON_SIZE pixels are going to be shown: scale down while
+        // decoding instead of creating a full size image
+        QSize size = QSize(width, height).scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio);
+        QImage image(size.expandedTo(QSize(1, 1)), format);
+        PixelConversion::scaleDown(&image, ptr, width, height, lineCount, rowStride, fcn);
+        return image;
+    }
+
+    // Can we use the pixels as is? QImage requires 32 bit aligned lines for
+    // that.
+    QImage::Format wrapFormat = QImage::Format_Invalid;
+    if (bitsPerSample == 8 && channels == 3) {
+        wrapFormat = QImage::Format_RGB888;
+    }
+#if QT_VERSION >= 0x050200
+    if (bitsPerSample == 8 && channels == 4) {
+        wrapFormat = QImage::Format_RGBA8888;
+    }
+#endif
+    if (wrapFormat != QImage::Format_Invalid && rowStride % 4 == 0 && lineCount == height) {
+        return QImage(ptr, width, height, rowStride, wrapFormat);
+    }
+
     QImage image(width, height, format);
-    ptr = pixels.data();
-    end = ptr + pixels.length();
-    for (int y=0; y<height; ++y, ptr += rowStride) {
-        if (ptr + channels * width > end) {
-            kWarning() << "Image data is incomplete. y:" << y << "height:" << height;
-            break;
-        }
+    if (rowStride == lineLength && lineCount == height) {
+        // Rows are packed, and so are QImage 32 bit scanlines: convert the
+        // whole buffer at once
+        fcn(reinterpret_cast<QRgb*>(image.bits()), ptr, width * height);
+        return image;
+    }
+    if (lineCount < height) {
+        image.fill(0);
+    }
+    for (int y=0; y<lineCount; ++y, ptr += rowStride) {
         fcn((QRgb*)image.scanLine(y), ptr, width);
     }
 
     return image;
 }
 
-static QString findImageForSpecImagePath(const QString &_path)
+static qint64 pixmapBytes(const QPixmap& pixmap)
 {
-    QString path = _path;
-    if (path.startsWith("file:")) {
-        KUrl url(path);
-        path = url.toLocalFile();
-    }
-    return KIconLoader::global()->iconPath(path, -KIconLoader::SizeHuge,
-                                           true /* canReturnNull */);
+    return qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
+
+/**
+ * Approximate memory used by @p notification
+ */
+static qint64 notificationBytes(const Notification& notification)
+{
+    const int length = notification.appName.length()
+        + notification.appIcon.length()
+        + notification.summary.length()
+        + notification.body.length();
+    return length * sizeof(QChar) + pixmapBytes(notification.pixmap);
 }
 
 static int timeoutForText(const QString& text)
@@ -178,77 +261,268 @@ static int timeoutForText(const QString& text)
     return 1000 + 60000 * text.length() / AVERAGE_WORD_LENGTH / WORD_PER_MINUTE;
 }
 
-uint NotificationManager::Notify(const QString& appName, uint replacesId, const QString& appIcon, const QString& summary, const QString& body, const QStringList& /*actions*/, const QVariantMap& hints, int /*timeout*/)
+uint NotificationManager::Notify(const QString& appName, uint replacesId, const QString& appIcon, const QString& summary, const QString& body, const QStringList& actions, const QVariantMap& hints, int timeout)
+{
+    NotificationRequest request;
+    request.appName = appName;
+    request.replacesId = replacesId;
+    request.appIcon = appIcon;
+    request.summary = summary;
+    request.body = body;
+    request.actions = actions;
+    request.hints = hints;
+    request.timeout = timeout;
+    return admitRequest(request);
+}
+
+QList<uint> NotificationManager::NotifyBatch(const NotificationRequestList& requests)
+{
+    QList<uint> ids;
+    ids.reserve(requests.size());
+    Q_FOREACH(const NotificationRequest& request, requests) {
+        ids << admitRequest(request);
+    }
+    return ids;
+}
+
+uint NotificationManager::admitRequest(const NotificationRequest& request)
+{
+    // Only allocate an id here: the caller is waiting for it. The real work
+    // happens in processPendingRequests(), once we are back to the event
+    // loop. Rate limits and queue limits only apply there, so do not let
+    // the pending requests grow without bounds.
+    if (mPendingRequests.size() >= MAX_PENDING_REQUESTS || mPendingImageCount >= MAX_PENDING_IMAGES) {
+        processPendingRequests();
+    }
+    PendingRequest pending;
+    pending.request = request;
+    pending.id = mNextId++;
+    pending.receivedTime = mStats ? mStats->now() : 0;
+
+    // Most of a huge body would be truncated anyway. Keep enough room for a
+    // tag cut at the limit.
+    const int maxBodyLength = qMax(mConfig->maxBodyLength(), 0) + BodySanitizer::MAX_TAG_LENGTH;
+    if (request.body.length() > maxBodyLength) {
+        pending.request.body = request.body.left(maxBodyLength);
+    }
+    // Only keep the hints we use
+    QVariantMap hints;
+    if (request.hints.contains("urgency")) {
+        hints.insert("urgency", request.hints.value("urgency"));
+    }
+    if (request.hints.contains("image_path")) {
+        hints.insert("image_path", request.hints.value("image_path"));
+    }
+    const char* imageHint = request.hints.contains("image_data") ? "image_data"
+        : request.hints.contains("icon_data") ? "icon_data"
+        : 0;
+    if (imageHint) {
+        hints.insert(imageHint, request.hints.value(imageHint));
+        ++mPendingImageCount;
+    }
+    pending.request.hints = hints;
+
+    mPendingRequests << pending;
+    if (!mProcessTimer->isActive()) {
+        mProcessTimer->start();
+    }
+    return pending.id;
+}
+
+void NotificationManager::processPendingRequests()
+{
+    mProcessTimer->stop();
+    QList<PendingRequest> requests;
+    requests.swap(mPendingRequests);
+    mPendingImageCount = 0;
+    Q_FOREACH(const PendingRequest& pending, requests) {
+        const uint id = processNotify(pending.request, pending.id, pending.receivedTime);
+        // The request may have been merged into another notification: the
+        // app only knows about the id we gave it
+        if (id && id != pending.id) {
+            addAlias(pending.id, id);
+        }
+    }
+    // Only start showing notifications once all of them are in the queue
+    showNextNotification();
+}
+
+void NotificationManager::addAlias(uint alias, uint id)
+{
+    QList<uint>& aliases = mAliasesForId[id];
+    if (aliases.size() >= MAX_ALIASES_PER_ID) {
+        // An app keeps sending the same notification, it cannot be
+        // interested in all the ids we gave it
+        const uint oldAlias = aliases.takeFirst();
+        mAliases.remove(oldAlias);
+        NotificationClosed(oldAlias, CLOSE_REASON_UNDEFINED);
+    }
+    aliases << alias;
+    mAliases.insert(alias, id);
+}
+
+void NotificationManager::emitNotificationClosed(uint id, uint reason)
+{
+    NotificationClosed(id, reason);
+    Q_FOREACH(uint alias, mAliasesForId.take(id)) {
+        mAliases.remove(alias);
+        NotificationClosed(alias, reason);
+    }
+}
+
+uint NotificationManager::processNotify(const NotificationRequest& request, uint id, qint64 receivedTime)
 {
-    NotificationWidget* widget = findWidget(appName, summary);
-    QString cBody = cleanBody(body);
+    const QString& appName = request.appName;
+    const uint replacesId = request.replacesId;
+    const QString& appIcon = request.appIcon;
+    const QString& summary = request.summary;
+    const QString& body = request.body;
+    const QVariantMap& hints = request.hints;
+    int timeout = request.timeout;
+    int urgency = URGENCY_NORMAL;
+    if (hints.contains("urgency")) {
+        urgency = qBound(URGENCY_LOW, hints["urgency"].toInt(), URGENCY_CRITICAL);
+    }
+
+    // Only look for notifications of the same urgency: a more urgent one must
+    // go through its own queue level and preempt the less urgent ones
+    uint existingId = findId(appName, summary, urgency);
+    QString cBody = BodySanitizer::sanitize(body);
      // Block already existing notifications
-    if (widget && widget->summary() == summary && widget->body() == cBody) {
-        return replacesId;
+    if (existingId && mNotifications.value(existingId).body == cBody) {
+        return existingId;
     }
 
     if (replacesId > 0) {
         CloseNotification(replacesId);
+        // Closing may have unregistered the notification we found
+        existingId = findId(appName, summary, urgency);
     }
 
     // Can we append to an existing notification?
-    widget = findWidget(appName, summary);
-    if (widget && widget->summary() == summary && !body.isEmpty()) {
-        int timeout = timeoutForText(body);
-        widget->appendToBody(cBody, timeout);
-        return widget->id();
+    if (existingId && !body.isEmpty()) {
+        appendToNotification(existingId, cBody);
+        enforceQueueLimits();
+        return existingId;
+    }
+
+    // Merge notifications which only differ by numbers, like "Build #1234
+    // failed" and "Build #1235 failed". Critical notifications must all be
+    // shown, and they must not wait behind a less urgent one.
+    uint fingerprint = 0;
+    if (mConfig->mergeSimilarNotifications() && urgency != URGENCY_CRITICAL) {
+        fingerprint = NotificationText::fingerprint(summary, body);
+        const uint similarId = findSimilarId(appName, fingerprint, urgency);
+        if (similarId) {
+            mergeInto(similarId, summary, cBody);
+            return similarId;
+        }
+    }
+
+    // Critical notifications must never wait, do not fold them
+    if (urgency != URGENCY_CRITICAL && !admitNotification(appName)) {
+        return foldNotification(appName, id);
     }
 
-    QPixmap pix;
+    Notification notification;
 
     // image
-    QImage image;
     if (hints.contains("image_data")) {
         QDBusArgument arg = hints["image_data"].value<QDBusArgument>();
-        image = decodeNotificationSpecImageHint(arg);
+        notification.pixmap = pixmapFromSpecImageHint(arg);
     } else if (hints.contains("image_path")) {
-        QString path = findImageForSpecImagePath(hints["image_path"].toString());
-        if (!path.isEmpty()) {
-            image.load(path);
-        }
+        notification.imagePending = true;
     } else if (hints.contains("icon_data")) {
         // This hint was in use in version 1.0 of the spec but has been
         // replaced by "image_data" in version 1.1. We need to support it for
         // users of the 1.0 version of the spec.
         QDBusArgument arg = hints["icon_data"].value<QDBusArgument>();
-        image = decodeNotificationSpecImageHint(arg);
+        notification.pixmap = pixmapFromSpecImageHint(arg);
     }
 
-    int timeout = qBound(2000, timeoutForText(summary + body), 20000);
+    notification.id = id;
+    notification.appName = appName;
+    notification.appIcon = appIcon;
+    notification.summary = summary;
+    notification.body = NotificationText::truncateBody(cBody, mConfig->maxBodyLength());
+    notification.bodyTruncated = notification.body.length() != cBody.length();
+    if (timeout == 0) {
+        notification.neverExpires = true;
+    } else {
+        if (timeout < 0) {
+            timeout = timeoutForText(summary + notification.body);
+        }
+        notification.timeout = qBound(mConfig->minTimeout(), timeout, mConfig->maxTimeout());
+    }
+    notification.urgency = urgency;
 
-    // Id
-    uint id = mNextId++;
+    if (mStats) {
+        notification.receivedTime = receivedTime;
+        notification.queuedTime = mStats->now();
+        mStats->addSample(LatencyStats::DecodeStage, notification.queuedTime - receivedTime);
+    }
+    addNotification(notification);
+    if (fingerprint) {
+        addFingerprint(appName, fingerprint, notification.id);
+    }
+    if (notification.imagePending) {
+        mImageLoader->load(notification.id, hints["image_path"].toString());
+    }
+    const int collapseThreshold = mConfig->queueCollapseThreshold();
+    if (collapseThreshold > 0 && mQueue.size() > collapseThreshold) {
+        collapseQueue();
+    }
+    enforceQueueLimits();
+    if (notification.urgency == URGENCY_CRITICAL) {
+        preemptVisibleNotification();
+    }
+    kDebug() << "id:" << notification.id << "app:" << appName << "summary:" << summary << "timeout:" << notification.timeout;
+    kDebug() << "body:" << body;
+    return notification.id;
+}
 
-    // Create widget
-    widget = new NotificationWidget(appName, id, image, appIcon, summary, cBody, timeout);
+QPixmap NotificationManager::pixmapFromSpecImageHint(const QDBusArgument& arg)
+{
+    int width, height, rowStride, hasAlpha, bitsPerSample, channels;
+    QByteArray pixels;
 
-    // Update config, KCM may have changed it
-    mConfig->readConfig();
-    widget->setAlignment(Qt::Alignment(mConfig->alignment()));
-    widget->setScreen(mConfig->screen());
-    connect(widget, SIGNAL(closed(uint, uint)), SLOT(slotNotificationWidgetClosed(uint, uint)));
-    mWidgets << widget;
-    if (mWidgets.size() == 1) {
-        widget->start();
+    arg.beginStructure();
+    arg >> width >> height >> rowStride >> hasAlpha >> bitsPerSample >> channels >> pixels;
+    arg.endStructure();
+    //kDebug() << width << height << rowStride << hasAlpha << bitsPerSample << channels;
+
+    // Apps often send the same image over and over: hashing the pixels is
+    // much cheaper than decoding and scaling them
+    const QString key = QString("data:%1x%2:%3:%4:%5:")
+        .arg(width).arg(height).arg(rowStride).arg(bitsPerSample).arg(channels)
+        + QCryptographicHash::hash(pixels, QCryptographicHash::Md5).toHex();
+    QPixmap pixmap = mIconCache->find(key);
+    if (pixmap.isNull()) {
+        QImage image = decodeNotificationSpecImageHint(width, height, rowStride, hasAlpha, bitsPerSample, channels, pixels);
+        pixmap = QPixmap::fromImage(image);
+        mIconCache->insert(key, pixmap);
     }
-    kDebug() << "id:" << id << "app:" << appName << "summary:" << summary << "timeout:" << timeout;
-    kDebug() << "body:" << body;;
-    return id;
+    return pixmap;
 }
 
-void NotificationManager::CloseNotification(uint id)
+void NotificationManager::CloseNotification(uint _id)
 {
-    Q_FOREACH(NotificationWidget* widget, mWidgets) {
-        if (widget->id() == id) {
-            widget->closeWidget();
-            return;
-        }
+    // The notification may not have been processed yet
+    if (!mPendingRequests.isEmpty()) {
+        processPendingRequests();
+    }
+    const uint id = mAliases.value(_id, _id);
+    NotificationWidget* widget = findWidget(id);
+    if (widget) {
+        widget->closeWidget();
+        return;
+    }
+    if (!mNotifications.contains(id)) {
+        return;
     }
+    // Notification has not been shown yet, no need to go through a widget
+    removeNotification(id);
+    emitNotificationClosed(id, CLOSE_REASON_CLOSED_BY_APP);
 }
 
 QStringList NotificationManager::GetCapabilities()
@@ -258,9 +532,35 @@ QStringList NotificationManager::GetCapabilities()
         << "body-hyperlinks"
         << "body-markup"
         << "icon-static"
+        // Notifications are queued by urgency, critical ones preempt the
+        // others
+        << "x-colibri-urgency"
         ;
 }
 
+void NotificationManager::ReloadConfig()
+{
+    mConfig->readConfig();
+    mIconCache->setMaxSize(mConfig->iconCacheSize());
+    // There may be room for more notifications
+    showNextNotification();
+}
+
+QString NotificationManager::GetStatistics()
+{
+    if (!mStats) {
+        return "Statistics are disabled. Start Colibri with --stats to enable them.\n";
+    }
+    return mStats->toString();
+}
+
+void NotificationManager::ResetStatistics()
+{
+    if (mStats) {
+        mStats->reset();
+    }
+}
+
 QString NotificationManager::GetServerInformation(QString& vendor, QString& version, QString& specVersion)
 {
     vendor = "Aurélien Gâteau";
@@ -271,32 +571,500 @@ QString NotificationManager::GetServerInformation(QString& vendor, QString& vers
 
 void NotificationManager::slotNotificationWidgetClosed(uint id, uint reason)
 {
-    NotificationClosed(id, reason);
+    // Apps do not know about collapsed notifications
+    if (mNotifications.value(id).collapsedCount == 0) {
+        emitNotificationClosed(id, reason);
+    }
+
+    NotificationWidget* widget = findWidget(id);
+    if (!widget) {
+        kWarning() << "Closed widget is not visible! id:" << id;
+        return;
+    }
+    removeNotification(id);
+
+    // Keep the widget around, creating a new one for the next notification
+    // would cost us a new window. withdraw() stops its animations: they would
+    // show it again otherwise.
+    widget->withdraw();
+    mVisibleWidgets.removeOne(widget);
+    mWidgetPool << widget;
 
-    if (mWidgets.isEmpty()) {
-        kWarning() << "mWidgets should not be empty!";
+    // The widget is only hidden, so the last window is never closed: quit
+    // ourselves when running with --single
+    if (qApp->quitOnLastWindowClosed() && mVisibleWidgets.isEmpty()) {
+        qApp->quit();
         return;
     }
-    NotificationWidget* widget = mWidgets.takeFirst();
 
-    // Hack to workaround blinking when the notification is fading out
-    // See https://bugs.kde.org/show_bug.cgi?id=314427
-    widget->move(-widget->width(), 0);
-    widget->deleteLater();
+    updateStackOffsets();
+    showNextNotification();
+}
 
-    if (!mWidgets.isEmpty()) {
-        mWidgets.first()->start();
+void NotificationManager::showNextNotification()
+{
+    while (!mQueue.isEmpty() && mVisibleWidgets.size() < mConfig->maxVisibleNotifications()) {
+        Notification& notification = mNotifications[mQueue.head()];
+        if (notification.imagePending) {
+            // Give the image a chance to arrive before falling back to the app
+            // icon
+            if (mImageDeadlineId != notification.id) {
+                mImageDeadlineId = notification.id;
+                mImageDeadlineTimer->start();
+                return;
+            }
+            if (mImageDeadlineTimer->isActive()) {
+                return;
+            }
+        }
+        mImageDeadlineTimer->stop();
+        mQueue.takeHead();
+        mQueuedBytes -= notificationBytes(notification);
+        showNotification(notification);
     }
 }
 
-NotificationWidget* NotificationManager::findWidget(const QString& appName, const QString& summary)
+void NotificationManager::showNotification(Notification& notification)
 {
-    Q_FOREACH(NotificationWidget* widget, mWidgets) {
-        if (widget->appName() == appName && widget->summary() == summary) {
+    qint64 dequeuedTime = 0;
+    if (mStats) {
+        dequeuedTime = mStats->now();
+        mStats->addSample(LatencyStats::QueueStage, dequeuedTime - notification.queuedTime);
+    }
+    NotificationWidget* widget;
+    if (mWidgetPool.isEmpty()) {
+        widget = new NotificationWidget;
+        connect(widget, SIGNAL(closed(uint, uint)), SLOT(slotNotificationWidgetClosed(uint, uint)));
+        connect(widget, SIGNAL(idealGeometryChanged()), SLOT(updateStackOffsets()));
+        connect(widget, SIGNAL(shown(uint)), SLOT(slotNotificationWidgetShown(uint)));
+    } else {
+        widget = mWidgetPool.takeLast();
+    }
+
+    if (notification.pixmap.isNull()) {
+        notification.pixmap = mIconCache->appIconPixmap(notification.appIcon);
+    }
+    // Make room for the notifications waiting behind this one
+    const int shortenThreshold = mConfig->queueShortenThreshold();
+    if (shortenThreshold > 0 && mQueue.size() > shortenThreshold && !notification.neverExpires) {
+        notification.timeout = qMax(mConfig->minTimeout(), notification.timeout * shortenThreshold / mQueue.size());
+    }
+    widget->setNotification(notification);
+
+    widget->setAlignment(Qt::Alignment(mConfig->alignment()));
+    widget->setScreen(mConfig->screen());
+    mVisibleWidgets << widget;
+    updateStackOffsets();
+    widget->start();
+    if (mStats) {
+        notification.shownTime = mStats->now();
+        mStats->addSample(LatencyStats::SetupStage, notification.shownTime - dequeuedTime);
+    }
+}
+
+void NotificationManager::slotNotificationWidgetShown(uint id)
+{
+    if (!mStats) {
+        return;
+    }
+    QHash<uint, Notification>::Iterator it = mNotifications.find(id);
+    if (it == mNotifications.end()) {
+        return;
+    }
+    const qint64 time = mStats->now();
+    mStats->addSample(LatencyStats::FadeInStage, time - it->shownTime);
+    // Notifications can be shown several times if they are preempted, only
+    // count the first time. Collapsed notifications have no receivedTime.
+    if (it->receivedTime) {
+        mStats->addSample(LatencyStats::TotalStage, time - it->receivedTime);
+        it->receivedTime = 0;
+    }
+}
+
+void NotificationManager::preemptVisibleNotification()
+{
+    if (mVisibleWidgets.size() < mConfig->maxVisibleNotifications()) {
+        return;
+    }
+    // Send the oldest of the least urgent notifications back to the queue
+    NotificationWidget* preempted = 0;
+    int preemptedUrgency = URGENCY_CRITICAL;
+    Q_FOREACH(NotificationWidget* widget, mVisibleWidgets) {
+        const int urgency = mNotifications.value(widget->id()).urgency;
+        // Widgets which are fading out are about to make room anyway
+        if (urgency < preemptedUrgency && (widget->neverExpires() || widget->remainingTime() > 0)) {
+            preempted = widget;
+            preemptedUrgency = urgency;
+        }
+    }
+    if (!preempted) {
+        return;
+    }
+    Notification& notification = mNotifications[preempted->id()];
+    if (!notification.neverExpires) {
+        notification.timeout = qMax(mConfig->minTimeout(), preempted->remainingTime());
+    }
+    kDebug() << "Preempting" << notification.id << "remaining time:" << notification.timeout;
+    preempted->withdraw();
+    mVisibleWidgets.removeOne(preempted);
+    mWidgetPool << preempted;
+    if (mStats) {
+        notification.queuedTime = mStats->now();
+    }
+    mQueue.requeue(notification.id, notification.urgency);
+    mQueuedBytes += notificationBytes(notification);
+    updateStackOffsets();
+}
+
+void NotificationManager::updateStackOffsets()
+{
+    // Oldest widgets are closest to the edge of the screen
+    int offset = 0;
+    Q_FOREACH(NotificationWidget* widget, mVisibleWidgets) {
+        widget->setStackOffset(offset);
+        offset += widget->idealGeometry().height() + BUBBLE_SPACING;
+    }
+}
+
+void NotificationManager::slotImageLoaded(uint id, const QPixmap& pixmap)
+{
+    QHash<uint, Notification>::Iterator it = mNotifications.find(id);
+    if (it == mNotifications.end()) {
+        // Closed in the meantime
+        return;
+    }
+    it->imagePending = false;
+    if (!pixmap.isNull()) {
+        if (mQueue.contains(id)) {
+            mQueuedBytes += pixmapBytes(pixmap) - pixmapBytes(it->pixmap);
+        }
+        it->pixmap = pixmap;
+    }
+    NotificationWidget* widget = findWidget(id);
+    if (widget) {
+        // Deadline expired, the widget is showing the app icon
+        if (!pixmap.isNull()) {
+            widget->setPixmap(pixmap);
+        }
+    } else if (!mQueue.isEmpty() && mQueue.head() == id) {
+        showNextNotification();
+    }
+}
+
+NotificationWidget* NotificationManager::findWidget(uint id) const
+{
+    Q_FOREACH(NotificationWidget* widget, mVisibleWidgets) {
+        if (widget->id() == id) {
             return widget;
         }
     }
     return 0;
 }
 
+uint NotificationManager::findId(const QString& appName, const QString& summary, int urgency) const
+{
+    // If several notifications share the same key, return the most recent
+    // one: this is the one new content should be appended to
+    QHash<NotificationKey, QList<uint> >::ConstIterator it = mIdsForKey.constFind(NotificationKey(appName, summary));
+    if (it == mIdsForKey.constEnd()) {
+        return 0;
+    }
+    for (int idx = it->count() - 1; idx >= 0; --idx) {
+        const uint id = it->at(idx);
+        if (mNotifications.value(id).urgency == urgency) {
+            return id;
+        }
+    }
+    return 0;
+}
+
+void NotificationManager::addKey(const Notification& notification)
+{
+    mIdsForKey[NotificationKey(notification.appName, notification.summary)] << notification.id;
+}
+
+void NotificationManager::removeKey(const Notification& notification)
+{
+    QHash<NotificationKey, QList<uint> >::Iterator it = mIdsForKey.find(NotificationKey(notification.appName, notification.summary));
+    if (it == mIdsForKey.end()) {
+        return;
+    }
+    // Older notifications with the same key take over
+    it->removeOne(notification.id);
+    if (it->isEmpty()) {
+        mIdsForKey.erase(it);
+    }
+}
+
+void NotificationManager::addNotification(const Notification& notification)
+{
+    mNotifications.insert(notification.id, notification);
+    mQueuedBytes += notificationBytes(notification);
+    addKey(notification);
+    mLastIdForApp.insert(notification.appName, notification.id);
+    mQueue.enqueue(notification.id, notification.urgency);
+}
+
+void NotificationManager::removeNotification(uint id)
+{
+    QHash<uint, Notification>::Iterator it = mNotifications.find(id);
+    if (it == mNotifications.end()) {
+        return;
+    }
+    removeKey(*it);
+    if (mLastIdForApp.value(it->appName) == id) {
+        mLastIdForApp.remove(it->appName);
+    }
+    if (mQueue.contains(id)) {
+        mQueuedBytes -= notificationBytes(*it);
+    }
+    mNotifications.erase(it);
+    mQueue.removeOne(id);
+}
+
+void NotificationManager::collapseQueue()
+{
+    // Critical notifications must all be shown
+    for (int urgency = URGENCY_LOW; urgency < URGENCY_CRITICAL; ++urgency) {
+        collapseQueueLevel(urgency);
+    }
+}
+
+void NotificationManager::collapseQueueLevel(int urgency)
+{
+    // Group pending notifications by app, in queue order
+    QList<QString> appNames;
+    QHash<QString, QList<uint> > idsForApp;
+    Q_FOREACH(uint id, mQueue.level(urgency)) {
+        const QString appName = mNotifications.value(id).appName;
+        QList<uint>& ids = idsForApp[appName];
+        if (ids.isEmpty()) {
+            appNames << appName;
+        }
+        ids << id;
+    }
+
+    Q_FOREACH(const QString& appName, appNames) {
+        const QList<uint> ids = idsForApp.value(appName);
+        if (ids.size() < 2) {
+            continue;
+        }
+        Notification collapsed;
+        collapsed.id = mNextId++;
+        collapsed.appName = appName;
+        collapsed.appIcon = mNotifications.value(ids.first()).appIcon;
+        collapsed.urgency = urgency;
+        const int pos = mQueue.level(urgency).indexOf(ids.first());
+        Q_FOREACH(uint id, ids) {
+            const int count = mNotifications.value(id).collapsedCount;
+            collapsed.collapsedCount += qMax(count, 1);
+            removeNotification(id);
+            // Summaries are ours, apps do not know about them
+            if (count == 0) {
+                emitNotificationClosed(id, CLOSE_REASON_UNDEFINED);
+            }
+        }
+        collapsed.summary = i18np("1 more from %2", "%1 more from %2", collapsed.collapsedCount, appName);
+        collapsed.timeout = qBound(mConfig->minTimeout(), timeoutForText(collapsed.summary), mConfig->maxTimeout());
+        kDebug() << "Collapsed" << collapsed.collapsedCount << "notifications from" << appName;
+
+        // Do not go through addNotification(): the summary must not be
+        // appended to, and it takes the place of the first collapsed
+        // notification in the queue
+        if (mStats) {
+            collapsed.queuedTime = mStats->now();
+        }
+        mNotifications.insert(collapsed.id, collapsed);
+        mQueuedBytes += notificationBytes(collapsed);
+        mQueue.insert(urgency, pos, collapsed.id);
+    }
+}
+
+bool NotificationManager::admitNotification(const QString& appName)
+{
+    const int ratePerMinute = mConfig->rateLimitPerMinute();
+    if (ratePerMinute <= 0) {
+        return true;
+    }
+    const int burst = qMax(mConfig->rateLimitBurst(), 1);
+    const qint64 time = mClock.elapsed();
+
+    // Token bucket: apps get ratePerMinute tokens per minute, up to burst
+    // tokens, and each notification costs one token
+    QHash<QString, TokenBucket>::Iterator it = mTokenBuckets.find(appName);
+    if (it == mTokenBuckets.end()) {
+        if (mTokenBuckets.size() >= MAX_TOKEN_BUCKETS) {
+            pruneTokenBuckets(time, ratePerMinute, burst);
+        }
+        it = mTokenBuckets.insert(appName, TokenBucket());
+        it->tokens = burst;
+    } else {
+        it->tokens = qMin(qreal(burst), it->tokens + (time - it->time) * ratePerMinute / 60000.);
+    }
+    it->time = time;
+    if (it->tokens < 1) {
+        return false;
+    }
+    it->tokens -= 1;
+    return true;
+}
+
+void NotificationManager::pruneTokenBuckets(qint64 time, int ratePerMinute, int burst)
+{
+    // Full buckets are equivalent to no bucket
+    QHash<QString, TokenBucket>::Iterator it = mTokenBuckets.begin();
+    while (it != mTokenBuckets.end()) {
+        if (it->tokens + (time - it->time) * ratePerMinute / 60000. >= burst) {
+            it = mTokenBuckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void NotificationManager::foldInto(uint id)
+{
+    Notification& notification = mNotifications[id];
+    ++notification.foldedCount;
+    NotificationWidget* widget = findWidget(id);
+    if (widget) {
+        widget->setFoldedCount(notification.foldedCount);
+    }
+}
+
+void NotificationManager::mergeInto(uint id, const QString& summary, const QString& body)
+{
+    // Show the most recent content: "Battery at 15%" is of no use once we
+    // got "Battery at 10%"
+    Notification& notification = mNotifications[id];
+    removeKey(notification);
+    const bool queued = mQueue.contains(id);
+    if (queued) {
+        mQueuedBytes -= notificationBytes(notification);
+    }
+    notification.summary = summary;
+    notification.body = NotificationText::truncateBody(body, mConfig->maxBodyLength());
+    notification.bodyTruncated = notification.body.length() != body.length();
+    if (queued) {
+        mQueuedBytes += notificationBytes(notification);
+    }
+    addKey(notification);
+
+    NotificationWidget* widget = findWidget(id);
+    if (widget) {
+        widget->setText(notification.summary, notification.body);
+    }
+    foldInto(id);
+}
+
+uint NotificationManager::foldNotification(const QString& appName, uint droppedId)
+{
+    const uint id = mLastIdForApp.value(appName);
+    if (id) {
+        foldInto(id);
+        return id;
+    }
+    // Nothing to fold into: drop it
+    kDebug() << "Rate limit exceeded for" << appName << ", dropping notification" << droppedId;
+    NotificationClosed(droppedId, CLOSE_REASON_UNDEFINED);
+    return 0;
+}
+
+uint NotificationManager::findSimilarId(const QString& appName, uint fingerprint, int urgency) const
+{
+    QHash<QString, QList<Fingerprint> >::ConstIterator it = mFingerprints.constFind(appName);
+    if (it == mFingerprints.constEnd()) {
+        return 0;
+    }
+    Q_FOREACH(const Fingerprint& entry, *it) {
+        if (entry.fingerprint != fingerprint) {
+            continue;
+        }
+        QHash<uint, Notification>::ConstIterator notification = mNotifications.constFind(entry.id);
+        if (notification != mNotifications.constEnd() && notification->urgency == urgency) {
+            return entry.id;
+        }
+    }
+    return 0;
+}
+
+void NotificationManager::addFingerprint(const QString& appName, uint fingerprint, uint id)
+{
+    QHash<QString, QList<Fingerprint> >::Iterator it = mFingerprints.find(appName);
+    if (it == mFingerprints.end()) {
+        if (mFingerprints.size() >= MAX_FINGERPRINT_APPS) {
+            pruneFingerprints();
+        }
+        it = mFingerprints.insert(appName, QList<Fingerprint>());
+    }
+    Fingerprint entry;
+    entry.fingerprint = fingerprint;
+    entry.id = id;
+    it->prepend(entry);
+    if (it->size() > FINGERPRINT_WINDOW) {
+        it->removeLast();
+    }
+}
+
+void NotificationManager::pruneFingerprints()
+{
+    // Forget about apps which have no notification left
+    QHash<QString, QList<Fingerprint> >::Iterator it = mFingerprints.begin();
+    while (it != mFingerprints.end()) {
+        bool alive = false;
+        Q_FOREACH(const Fingerprint& entry, *it) {
+            if (mNotifications.contains(entry.id)) {
+                alive = true;
+                break;
+            }
+        }
+        if (alive) {
+            ++it;
+        } else {
+            it = mFingerprints.erase(it);
+        }
+    }
+}
+
+void NotificationManager::enforceQueueLimits()
+{
+    const int maxCount = mConfig->maxQueuedNotifications();
+    const qint64 maxBytes = qint64(mConfig->maxQueuedSize()) * 1024;
+    const NotificationQueue::EvictionPolicy policy =
+        mConfig->evictionPolicy() == Config::EnumEvictionPolicy::OldestLowUrgency
+        ? NotificationQueue::OldestLowUrgency
+        : NotificationQueue::NoisiestApp;
+    while (!mQueue.isEmpty() && (mQueue.size() > maxCount || mQueuedBytes > maxBytes)) {
+        const uint id = mQueue.findEvictionCandidate(mNotifications, policy);
+        const bool isCollapsed = mNotifications.value(id).collapsedCount > 0;
+        kDebug() << "Evicting" << id << "queued:" << mQueue.size() << "bytes:" << mQueuedBytes;
+        removeNotification(id);
+        // Apps do not know about collapsed notifications
+        if (!isCollapsed) {
+            emitNotificationClosed(id, CLOSE_REASON_UNDEFINED);
+        }
+    }
+}
+
+void NotificationManager::appendToNotification(uint id, const QString& _body)
+{
+    Notification& notification = mNotifications[id];
+    if (notification.bodyTruncated) {
+        kDebug() << "Body of" << id << "is full, dropping appended text";
+        return;
+    }
+    const QString body = NotificationText::truncateBody(_body, mConfig->maxBodyLength() - notification.body.length());
+    notification.bodyTruncated = body.length() != _body.length();
+    const int timeout = timeoutForText(body);
+    notification.body += body;
+    if (mQueue.contains(id)) {
+        mQueuedBytes += body.length() * sizeof(QChar);
+    }
+    notification.timeout += timeout;
+    NotificationWidget* widget = findWidget(id);
+    if (widget) {
+        widget->appendToBody(body, timeout);
+    }
+}
+
 } // namespace
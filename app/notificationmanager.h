@@ -22,17 +22,30 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #define NOTIFICATIONMANAGER_H
 
 // Qt
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
 #include <QObject>
+#include <QPair>
 #include <QVariant>
 
 // KDE
 
 // Local
+#include <notification.h>
+#include <notificationqueue.h>
+#include <notificationrequest.h>
+
+class QDBusArgument;
+class QTimer;
 
 namespace Colibri
 {
 
 class Config;
+class IconCache;
+class ImageLoader;
+class LatencyStats;
 
 class NotificationWidget;
 class NotificationManager : public QObject
@@ -44,6 +57,12 @@ public:
 
     bool connectOnDBus();
 
+    /**
+     * Starts collecting latency statistics. They are printed on exit and can
+     * be retrieved with GetStatistics().
+     */
+    void enableStatistics();
+
     uint Notify(const QString& appName, uint replacesId, const QString& appIcon, const QString& summary, const QString& body, const QStringList& actions, const QVariantMap& hints, int timeout);
 
     void CloseNotification(uint id);
@@ -52,19 +71,127 @@ public:
 
     QString GetServerInformation(QString& vendor, QString& version, QString& specVersion);
 
+    // org.kde.Colibri extensions
+
+    /**
+     * Same as calling Notify() for each request, but the queue is only
+     * processed once
+     */
+    QList<uint> NotifyBatch(const NotificationRequestList& requests);
+
+    /**
+     * Reads the configuration again. Called by the KCM when settings change.
+     */
+    void ReloadConfig();
+
+    QString GetStatistics();
+
+    void ResetStatistics();
+
 Q_SIGNALS:
     void NotificationClosed(uint id, uint reason);
     void ActionInvoked(uint id, const QString& actionKey);
 
 private Q_SLOTS:
     void slotNotificationWidgetClosed(uint id, uint reason);
+    void slotImageLoaded(uint id, const QPixmap&);
+    void slotNotificationWidgetShown(uint id);
+    void showNextNotification();
+    void processPendingRequests();
+    void updateStackOffsets();
 
 private:
-    QList<NotificationWidget*> mWidgets;
+    typedef QPair<QString, QString> NotificationKey;
+
+    // All notifications, pending or shown, indexed by id
+    QHash<uint, Notification> mNotifications;
+    // Notification ids for an (appName, summary) pair, oldest first
+    QHash<NotificationKey, QList<uint> > mIdsForKey;
+    // Most recent notification of each app
+    QHash<QString, uint> mLastIdForApp;
+    // Ids of the notifications waiting to be shown
+    NotificationQueue mQueue;
+    // Widgets currently shown, oldest first
+    QList<NotificationWidget*> mVisibleWidgets;
+    // Hidden widgets, ready to be reused
+    QList<NotificationWidget*> mWidgetPool;
     uint mNextId;
-    Config* mConfig;
 
-    NotificationWidget* findWidget(const QString& appName, const QString& summary);
+    struct TokenBucket
+    {
+        TokenBucket() : tokens(0), time(0) {}
+        qreal tokens;
+        // Last time tokens was updated, from mClock
+        qint64 time;
+    };
+    QHash<QString, TokenBucket> mTokenBuckets;
+
+    struct Fingerprint
+    {
+        uint fingerprint;
+        uint id;
+    };
+    // Fingerprints of the recent notifications of each app, most recent
+    // first
+    QHash<QString, QList<Fingerprint> > mFingerprints;
+    QElapsedTimer mClock;
+    Config* mConfig;
+    IconCache* mIconCache;
+    ImageLoader* mImageLoader;
+    // Null unless statistics are enabled
+    LatencyStats* mStats;
+    // Approximate memory used by the notifications of mQueue. Visible
+    // notifications cannot be evicted, so they do not count.
+    qint64 mQueuedBytes;
+    // Started when the head of the queue is still waiting for its image
+    QTimer* mImageDeadlineTimer;
+    uint mImageDeadlineId;
+
+    // Requests received by Notify() and NotifyBatch(), processed once we are
+    // back to the event loop
+    struct PendingRequest
+    {
+        NotificationRequest request;
+        uint id;
+        qint64 receivedTime;
+    };
+    QList<PendingRequest> mPendingRequests;
+    QTimer* mProcessTimer;
+    // Number of image_data or icon_data hints in mPendingRequests
+    int mPendingImageCount;
+
+    // Ids returned for requests which have been merged into another
+    // notification (appended, folded...), and the notification they have
+    // been merged into
+    QHash<uint, uint> mAliases;
+    // Aliases of each notification, oldest first
+    QHash<uint, QList<uint> > mAliasesForId;
+
+    QPixmap pixmapFromSpecImageHint(const QDBusArgument&);
+    uint admitRequest(const NotificationRequest&);
+    uint processNotify(const NotificationRequest&, uint id, qint64 receivedTime);
+    void addAlias(uint alias, uint id);
+    void emitNotificationClosed(uint id, uint reason);
+    uint findId(const QString& appName, const QString& summary, int urgency) const;
+    NotificationWidget* findWidget(uint id) const;
+    void showNotification(Notification&);
+    void addKey(const Notification&);
+    void removeKey(const Notification&);
+    void addNotification(const Notification&);
+    void removeNotification(uint id);
+    void appendToNotification(uint id, const QString& body);
+    bool admitNotification(const QString& appName);
+    void pruneTokenBuckets(qint64 time, int ratePerMinute, int burst);
+    uint foldNotification(const QString& appName, uint droppedId);
+    void foldInto(uint id);
+    uint findSimilarId(const QString& appName, uint fingerprint, int urgency) const;
+    void mergeInto(uint id, const QString& summary, const QString& body);
+    void addFingerprint(const QString& appName, uint fingerprint, uint id);
+    void pruneFingerprints();
+    void enforceQueueLimits();
+    void collapseQueue();
+    void collapseQueueLevel(int urgency);
+    void preemptVisibleNotification();
 };
 
 } // namespace
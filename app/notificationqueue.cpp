@@ -0,0 +1,137 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "notificationqueue.h"
+
+// Qt
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+NotificationQueue::NotificationQueue()
+{
+}
+
+bool NotificationQueue::isEmpty() const
+{
+    return mIds.isEmpty();
+}
+
+int NotificationQueue::size() const
+{
+    return mIds.size();
+}
+
+uint NotificationQueue::head() const
+{
+    for (int urgency = URGENCY_COUNT - 1; urgency >= 0; --urgency) {
+        if (!mLevels[urgency].isEmpty()) {
+            return mLevels[urgency].first();
+        }
+    }
+    Q_ASSERT(0);
+    return 0;
+}
+
+uint NotificationQueue::takeHead()
+{
+    for (int urgency = URGENCY_COUNT - 1; urgency >= 0; --urgency) {
+        if (!mLevels[urgency].isEmpty()) {
+            const uint id = mLevels[urgency].takeFirst();
+            mIds.remove(id);
+            return id;
+        }
+    }
+    Q_ASSERT(0);
+    return 0;
+}
+
+void NotificationQueue::enqueue(uint id, int urgency)
+{
+    mLevels[urgency].append(id);
+    mIds.insert(id);
+}
+
+void NotificationQueue::requeue(uint id, int urgency)
+{
+    insert(urgency, 0, id);
+}
+
+void NotificationQueue::insert(int urgency, int index, uint id)
+{
+    mLevels[urgency].insert(index, id);
+    mIds.insert(id);
+}
+
+void NotificationQueue::removeOne(uint id)
+{
+    // Most notifications are removed once they have been shown, when they
+    // are not in the queue anymore
+    if (!mIds.remove(id)) {
+        return;
+    }
+    for (int urgency = 0; urgency < URGENCY_COUNT; ++urgency) {
+        if (mLevels[urgency].removeOne(id)) {
+            return;
+        }
+    }
+}
+
+bool NotificationQueue::contains(uint id) const
+{
+    return mIds.contains(id);
+}
+
+uint NotificationQueue::findEvictionCandidate(const QHash<uint, Notification>& notifications, EvictionPolicy policy) const
+{
+    int urgency = URGENCY_LOW;
+    while (mLevels[urgency].isEmpty()) {
+        ++urgency;
+    }
+    const QList<uint>& ids = mLevels[urgency];
+    if (policy == OldestLowUrgency) {
+        return ids.first();
+    }
+
+    QHash<QString, int> countForApp;
+    QString noisiestApp;
+    int noisiestCount = 0;
+    Q_FOREACH(uint id, ids) {
+        const QString& appName = notifications.constFind(id)->appName;
+        const int count = ++countForApp[appName];
+        if (count > noisiestCount) {
+            noisiestApp = appName;
+            noisiestCount = count;
+        }
+    }
+    Q_FOREACH(uint id, ids) {
+        if (notifications.constFind(id)->appName == noisiestApp) {
+            return id;
+        }
+    }
+    return ids.first();
+}
+
+} // namespace
@@ -0,0 +1,107 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef NOTIFICATIONQUEUE_H
+#define NOTIFICATIONQUEUE_H
+
+// Qt
+#include <QHash>
+#include <QList>
+#include <QSet>
+
+// KDE
+
+// Local
+#include <notification.h>
+
+namespace Colibri
+{
+
+/**
+ * The ids of the notifications waiting to be shown, ordered by urgency, then
+ * by arrival.
+ */
+class NotificationQueue
+{
+public:
+    /**
+     * Which notification findEvictionCandidate() picks, among those of the
+     * lowest urgency
+     */
+    enum EvictionPolicy {
+        // The oldest one
+        OldestLowUrgency,
+        // The oldest one of the app with the most queued notifications
+        NoisiestApp
+    };
+
+    NotificationQueue();
+
+    bool isEmpty() const;
+
+    int size() const;
+
+    /**
+     * The id of the next notification to show. Queue must not be empty.
+     */
+    uint head() const;
+
+    uint takeHead();
+
+    void enqueue(uint id, int urgency);
+
+    /**
+     * Puts @p id in front of the notifications of the same urgency. Used to
+     * give back its place to a notification which has been preempted.
+     */
+    void requeue(uint id, int urgency);
+
+    /**
+     * Inserts @p id at position @p index among the notifications of urgency
+     * @p urgency
+     */
+    void insert(int urgency, int index, uint id);
+
+    void removeOne(uint id);
+
+    bool contains(uint id) const;
+
+    /**
+     * The ids of the notifications of urgency @p urgency, in arrival order
+     */
+    const QList<uint>& level(int urgency) const { return mLevels[urgency]; }
+
+    /**
+     * The id of the notification to evict when the queue is too large.
+     * Critical notifications are only evicted if there is nothing else.
+     * @p notifications must contain all the queued ids. Queue must not be
+     * empty.
+     */
+    uint findEvictionCandidate(const QHash<uint, Notification>& notifications, EvictionPolicy policy) const;
+
+private:
+    QList<uint> mLevels[URGENCY_COUNT];
+    // All the ids of mLevels, for fast lookups
+    QSet<uint> mIds;
+};
+
+} // namespace
+
+#endif /* NOTIFICATIONQUEUE_H */
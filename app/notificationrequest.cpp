@@ -0,0 +1,65 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "notificationrequest.h"
+
+// Qt
+#include <QDBusArgument>
+#include <QDBusMetaType>
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+QDBusArgument& operator<<(QDBusArgument& arg, const NotificationRequest& request)
+{
+    arg.beginStructure();
+    arg << request.appName
+        << request.replacesId
+        << request.appIcon
+        << request.summary
+        << request.body
+        << request.actions
+        << request.hints
+        << request.timeout;
+    arg.endStructure();
+    return arg;
+}
+
+const QDBusArgument& operator>>(const QDBusArgument& arg, NotificationRequest& request)
+{
+    arg.beginStructure();
+    arg >> request.appName
+        >> request.replacesId
+        >> request.appIcon
+        >> request.summary
+        >> request.body
+        >> request.actions
+        >> request.hints
+        >> request.timeout;
+    arg.endStructure();
+    return arg;
+}
+
+} // namespace
@@ -0,0 +1,71 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef NOTIFICATIONREQUEST_H
+#define NOTIFICATIONREQUEST_H
+
+// Qt
+#include <QList>
+#include <QMetaType>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+class QDBusArgument;
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+/**
+ * The arguments of a Notify() call, as a struct so that several of them can
+ * be sent at once with NotifyBatch(). D-Bus signature: (susssasa{sv}i)
+ */
+struct NotificationRequest
+{
+    NotificationRequest()
+    : replacesId(0)
+    , timeout(-1)
+    {}
+
+    QString appName;
+    uint replacesId;
+    QString appIcon;
+    QString summary;
+    QString body;
+    QStringList actions;
+    QVariantMap hints;
+    int timeout;
+};
+
+typedef QList<NotificationRequest> NotificationRequestList;
+
+QDBusArgument& operator<<(QDBusArgument&, const NotificationRequest&);
+const QDBusArgument& operator>>(const QDBusArgument&, NotificationRequest&);
+
+} // namespace
+
+Q_DECLARE_METATYPE(Colibri::NotificationRequest)
+Q_DECLARE_METATYPE(Colibri::NotificationRequestList)
+
+#endif /* NOTIFICATIONREQUEST_H */
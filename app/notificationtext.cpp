@@ -0,0 +1,94 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "notificationtext.h"
+
+// Qt
+#include <QHash>
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+namespace NotificationText
+{
+
+uint fingerprint(const QString& summary, const QString& body)
+{
+    QString text;
+    text.reserve(summary.length() + body.length() + 1);
+    bool inNumber = false;
+    bool inSpace = false;
+    const QString parts[2] = { summary, body };
+    for (int part = 0; part < 2; ++part) {
+        const QChar* ptr = parts[part].constData();
+        const QChar* end = ptr + parts[part].length();
+        for (; ptr != end; ++ptr) {
+            if (ptr->isDigit()) {
+                if (!inNumber) {
+                    text += '#';
+                    inNumber = true;
+                }
+                inSpace = false;
+            } else if (ptr->isSpace()) {
+                if (!inSpace) {
+                    text += ' ';
+                    inSpace = true;
+                }
+                inNumber = false;
+            } else {
+                text += ptr->toLower();
+                inNumber = false;
+                inSpace = false;
+            }
+        }
+        text += '\n';
+    }
+    return qMax(qHash(text), 1u);
+}
+
+QString truncateBody(const QString& body, int maxLength)
+{
+    if (body.length() <= maxLength) {
+        return body;
+    }
+    int length = qMax(maxLength, 0);
+    if (length > 0) {
+        const int tagStart = body.lastIndexOf('<', length - 1);
+        if (tagStart != -1 && body.lastIndexOf('>', length - 1) < tagStart) {
+            length = tagStart;
+        }
+    }
+    if (length > 0) {
+        const int entityStart = body.lastIndexOf('&', length - 1);
+        if (entityStart != -1 && body.lastIndexOf(';', length - 1) < entityStart) {
+            length = entityStart;
+        }
+    }
+    return body.left(length) + QChar(0x2026);
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,57 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef NOTIFICATIONTEXT_H
+#define NOTIFICATIONTEXT_H
+
+// Qt
+#include <QString>
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+/**
+ * Helpers working on the text of notifications
+ */
+namespace NotificationText
+{
+
+/**
+ * Hashes @p summary and @p body, ignoring case, the value of numbers and the
+ * amount of whitespace. Never returns 0.
+ */
+uint fingerprint(const QString& summary, const QString& body);
+
+/**
+ * Truncates @p body to @p maxLength chars, without cutting a tag or an entity
+ * in half, and adds an ellipsis if something has been removed. @p body must
+ * have been sanitized: '<' and '&' always start a tag or an entity.
+ */
+QString truncateBody(const QString& body, int maxLength);
+
+} // namespace
+
+} // namespace
+
+#endif /* NOTIFICATIONTEXT_H */
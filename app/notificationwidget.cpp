@@ -24,6 +24,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 
 // Local
 #include <hlayout.h>
+#include <notification.h>
+#include <pointerwatcher.h>
+#include <textwidget.h>
 
 // libc
 #include <math.h>
@@ -46,7 +49,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 
 // KDE
 #include <KDebug>
-#include <KIconLoader>
+#include <KLocale>
 #include <KWindowSystem>
 
 #include <Plasma/FrameSvg>
@@ -57,26 +60,26 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 namespace Colibri
 {
 
-static const uint CLOSE_REASON_EXPIRED        = 1;
-static const uint CLOSE_REASON_CLOSED_BY_USER = 2;
-static const uint CLOSE_REASON_CLOSED_BY_APP  = 3;
-
 static const int DEFAULT_BUBBLE_MIN_HEIGHT = 50;
 static const int DEFAULT_FADE_IN_TIMEOUT   = 250;
 static const int DEFAULT_FADE_OUT_TIMEOUT  = 1000;
 
 static const int GROW_ANIMATION_DURATION = 200;
 
-static const int ICON_SIZE = KIconLoader::SizeMedium;
-
 static const int ICON_TEXT_SPACING = 6;
 
 // 60 FPS to ensure a smooth animation
 static const int MOUSE_POLL_INTERVAL = 1000 / 60;
 
+// When polling, poll at MOUSE_POLL_INTERVAL only if the pointer is closer
+// than MOUSE_POLL_NEAR_DISTANCE, otherwise poll at MOUSE_POLL_IDLE_INTERVAL
+static const int MOUSE_POLL_IDLE_INTERVAL = 250;
+
 static const int   MOUSE_OVER_MARGIN      = 48;
 static const qreal MOUSE_OVER_OPACITY_MIN = .4;
 
+static const int MOUSE_POLL_NEAR_DISTANCE = 4 * MOUSE_OVER_MARGIN;
+
 // When running on a non composited desktop, if opacity is less than this value
 // the widget will be hidden (should not be less than MOUSE_OVER_OPACITY_MIN!)
 static const qreal NON_COMPOSITED_OPACITY_THRESHOLD = .4;
@@ -95,6 +98,17 @@ void State::switchToState(State* state)
     deleteLater();
 }
 
+void State::abort()
+{
+    // We may be called from one of our own slots, so we cannot be deleted
+    // right away. Make sure we won't affect the widget anymore.
+    Q_FOREACH(QAbstractAnimation* anim, findChildren<QAbstractAnimation*>()) {
+        anim->stop();
+    }
+    mNotificationWidget->visibleTimeLine()->disconnect(this);
+    deleteLater();
+}
+
 ////////////////////////////////////////////////////:
 // HiddenState
 ////////////////////////////////////////////////////:
@@ -128,6 +142,7 @@ FadeInState::FadeInState(NotificationWidget* widget)
 void FadeInState::slotFinished()
 {
     switchToState(new VisibleState(mNotificationWidget));
+    mNotificationWidget->emitShown();
 }
 
 
@@ -137,6 +152,9 @@ void FadeInState::slotFinished()
 VisibleState::VisibleState(NotificationWidget* widget)
 : State(widget)
 {
+    if (widget->neverExpires()) {
+        return;
+    }
     connect(widget->visibleTimeLine(), SIGNAL(finished()), SLOT(slotFinished()));
     if (widget->visibleTimeLine()->state() == QTimeLine::NotRunning) {
         widget->visibleTimeLine()->start();
@@ -150,12 +168,16 @@ void VisibleState::slotFinished()
 
 void VisibleState::onMouseOver()
 {
-    mNotificationWidget->visibleTimeLine()->setPaused(true);
+    if (!mNotificationWidget->neverExpires()) {
+        mNotificationWidget->visibleTimeLine()->setPaused(true);
+    }
 }
 
 void VisibleState::onMouseLeave()
 {
-    mNotificationWidget->visibleTimeLine()->setPaused(false);
+    if (!mNotificationWidget->neverExpires()) {
+        mNotificationWidget->visibleTimeLine()->setPaused(false);
+    }
 }
 
 ////////////////////////////////////////////////////:
@@ -182,139 +204,247 @@ void FadeOutState::slotFinished()
     mNotificationWidget->emitClosed();
 }
 
-static QPixmap pixmapFromImage(const QImage& image_)
-{
-    if (image_.isNull()) {
-        return QPixmap();
-    }
-    QImage image = image_;
-    if (qMax(image.width(), image.height()) > ICON_SIZE) {
-        image = image.scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    }
-    return QPixmap::fromImage(image);
-}
-
-static QPixmap pixmapFromAppIcon(const QString& appIcon)
-{
-    if (appIcon.isEmpty()) {
-        return QPixmap();
-    }
-    return KIconLoader::global()->loadIcon(appIcon, KIconLoader::Panel,
-        ICON_SIZE,
-        KIconLoader::DefaultState,
-        QStringList() /* overlays */,
-        0L /* path_store */,
-        true /* canReturnNull */);
-}
-
 ////////////////////////////////////////////////////:
 // NotificationWidget
 ////////////////////////////////////////////////////:
-NotificationWidget::NotificationWidget(const QString& appName, uint id, const QImage& image, const QString& appIcon, const QString& summary, const QString& body, int timeout)
+NotificationWidget::NotificationWidget()
 : Plasma::Dialog(0, Qt::X11BypassWindowManagerHint)
-, mAppName(appName)
-, mId(id)
-, mSummary(summary)
-, mBody(body)
-, mVisibleTimeLine(new QTimeLine(timeout, this))
+, mId(0)
+, mVisibleTimeLine(new QTimeLine(1000, this))
 , mScene(new QGraphicsScene(this))
 , mContainer(new QGraphicsWidget)
 , mHLayout(new HLayout(mContainer))
-, mIconLabel(0)
-, mTextLabel(new Plasma::Label(mContainer))
+, mIconLabel(new Plasma::Label(mContainer))
+, mTextLabel(new TextWidget(mContainer))
 , mBackgroundSvg(new Plasma::FrameSvg(this))
 , mCloseReason(CLOSE_REASON_EXPIRED)
+, mNeverExpires(false)
+, mFoldedCount(0)
 , mAlignment(Qt::AlignRight | Qt::AlignTop)
 , mScreen(-1)
+, mStackOffset(0)
 , mState(new HiddenState(this))
 , mMousePollTimer(new QTimer(this))
+, mRelayoutTimer(new QTimer(this))
+, mSummaryChanged(false)
 , mFadeOpacity(1.)
 , mMouseOverOpacity(1.)
+, mShadowMarginsValid(false)
+, mTrackingMouse(false)
+, mWatchingPointer(false)
 {
     // Setup the window properties
     KWindowSystem::setState(winId(), NET::KeepAbove);
     KWindowSystem::setType(winId(), NET::Notification);
+    setInputMask();
 
     // Background. This is only used to get the dialog margins
     mBackgroundSvg->setImagePath("dialogs/background");
     mBackgroundSvg->setEnabledBorders(Plasma::FrameSvg::AllBorders);
 
-    // Icon
-    QPixmap pix = pixmapFromImage(image);
-    if (pix.isNull()) {
-        pix = pixmapFromAppIcon(appIcon);
-    }
-
     // UI
     setMinimumHeight(DEFAULT_BUBBLE_MIN_HEIGHT);
 
-    if (!pix.isNull()) {
-        QSize size = pix.size();
-        mIconLabel = new Plasma::Label(mContainer);
-        mIconLabel->nativeWidget()->setPixmap(pix);
-        mIconLabel->nativeWidget()->setFixedSize(size);
-        mIconLabel->setMinimumSize(size);
-        mIconLabel->setMaximumSize(size);
-    }
-
-    mTextLabel->setWordWrap(true);
-
-    QFontMetrics fm = mTextLabel->nativeWidget()->fontMetrics();
-    mTextLabel->setMinimumWidth(20 * fm.averageCharWidth());
-    mTextLabel->setMinimumHeight(fm.height());
-    updateTextLabel();
-
     // Layout
-    if (mIconLabel) {
-        mHLayout->addWidget(mIconLabel);
-        mHLayout->setSpacing(ICON_TEXT_SPACING);
-    }
+    mHLayout->addWidget(mIconLabel);
+    mHLayout->setSpacing(ICON_TEXT_SPACING);
     mHLayout->addWidget(mTextLabel);
 
     mScene->addItem(mContainer);
     setGraphicsWidget(mContainer);
 
-    syncToGraphicsWidget();
-
     // Behavior
     setWindowOpacity(0);
     hide();
 
-    mMousePollTimer->setInterval(MOUSE_POLL_INTERVAL);
+    mRelayoutTimer->setSingleShot(true);
+    mRelayoutTimer->setInterval(0);
+    connect(mRelayoutTimer, SIGNAL(timeout()),
+        SLOT(relayout()));
+
+    mMousePollTimer->setSingleShot(true);
     connect(mMousePollTimer, SIGNAL(timeout()),
         SLOT(updateMouseOverOpacity()));
+    connect(PointerWatcher::self(), SIGNAL(screenLockChanged(bool)),
+        SLOT(slotScreenLockChanged(bool)));
+
+    connect(Plasma::Theme::defaultTheme(), SIGNAL(themeChanged()),
+        SLOT(invalidateShadowMargins()));
 }
 
-void NotificationWidget::updateTextLabel()
+NotificationWidget::~NotificationWidget()
+{
+    stopMouseTracking();
+}
+
+void NotificationWidget::setNotification(const Notification& notification)
+{
+    mAppName = notification.appName;
+    mId = notification.id;
+    mSummary = notification.summary;
+    mBody = notification.body;
+    mCloseReason = CLOSE_REASON_EXPIRED;
+    mNeverExpires = notification.neverExpires;
+    mFoldedCount = notification.foldedCount;
+
+    // Reset behavior
+    withdraw();
+    mStackOffset = 0;
+    if (!mNeverExpires) {
+        mVisibleTimeLine->setDuration(notification.timeout);
+    }
+    mVisibleTimeLine->setCurrentTime(0);
+    mFadeOpacity = 1.;
+    mMouseOverOpacity = 1.;
+    setWindowOpacity(0);
+
+    mRelayoutTimer->stop();
+    updateIconLabel(notification.pixmap);
+    updateTextLabel();
+    syncToGraphicsWidget();
+}
+
+void NotificationWidget::withdraw()
+{
+    mState->abort();
+    mState = new HiddenState(this);
+    stopMouseTracking();
+    mGrowAnimation.reset();
+    mVisibleTimeLine->stop();
+    // Hack to workaround blinking when the notification is fading out
+    // See https://bugs.kde.org/show_bug.cgi?id=314427
+    // start() moves the window back to its ideal geometry
+    move(-width(), 0);
+    hide();
+}
+
+int NotificationWidget::remainingTime() const
+{
+    return mVisibleTimeLine->duration() - mVisibleTimeLine->currentTime();
+}
+
+void NotificationWidget::setPixmap(const QPixmap& pix)
 {
-    QString text;
-    if (!mSummary.isEmpty()) {
-        text = "<b>" + mSummary + "</b>";
+    updateIconLabel(pix);
+    mHLayout->update();
+    if (isVisible()) {
+        animateToIdealGeometry();
     }
-    if (!mBody.isEmpty()) {
-        text += mBody.replace("\n", "<br>");
+    emit idealGeometryChanged();
+}
+
+void NotificationWidget::updateIconLabel(const QPixmap& pix)
+{
+    if (pix.isNull()) {
+        mIconLabel->hide();
+        return;
     }
-    mTextLabel->setText(text);
-    mTextLabel->resize(mTextLabel->preferredSize());
+    QSize size = pix.size();
+    mIconLabel->nativeWidget()->setPixmap(pix);
+    mIconLabel->nativeWidget()->setFixedSize(size);
+    mIconLabel->setMinimumSize(size);
+    mIconLabel->setMaximumSize(size);
+    mIconLabel->show();
+}
+
+void NotificationWidget::updateTextLabel()
+{
+    const QString summary = mFoldedCount > 0
+        ? i18nc("%1 is the summary, %2 the number of notifications folded into this one", "%1 (+%2)", mSummary, mFoldedCount)
+        : mSummary;
+    mTextLabel->setText(summary, mBody);
+    mPendingBody.clear();
+    mSummaryChanged = false;
     mHLayout->update();
 }
 
+void NotificationWidget::setFoldedCount(int count)
+{
+    mFoldedCount = count;
+    mSummaryChanged = true;
+    mRelayoutTimer->start();
+    mState->onAppended();
+}
+
+void NotificationWidget::setText(const QString& summary, const QString& body)
+{
+    mSummary = summary;
+    mBody = body;
+    mSummaryChanged = true;
+    mRelayoutTimer->start();
+    mState->onAppended();
+}
+
 void NotificationWidget::appendToBody(const QString& body, int timeout)
 {
     mBody += body;
+    mPendingBody += body;
     mVisibleTimeLine->setDuration(mVisibleTimeLine->duration() + timeout);
     kDebug() << "timeout:" << timeout << "new duration:" << mVisibleTimeLine->duration();
     kDebug() << "body:" << mBody;
-    updateTextLabel();
+    // Apps often send several lines in a row: lay out the text once for all
+    // of them
+    mRelayoutTimer->start();
+    mState->onAppended();
+}
+
+void NotificationWidget::relayout()
+{
+    mRelayoutTimer->stop();
+    if (mSummaryChanged) {
+        updateTextLabel();
+    } else {
+        mTextLabel->appendBody(mPendingBody);
+        mPendingBody.clear();
+        mHLayout->update();
+    }
     if (isVisible()) {
-        mGrowAnimation.reset(new QPropertyAnimation(this, "geometry"));
-        mGrowAnimation->setEasingCurve(QEasingCurve::OutQuad);
-        mGrowAnimation->setDuration(GROW_ANIMATION_DURATION);
-        mGrowAnimation->setStartValue(geometry());
-        mGrowAnimation->setEndValue(idealGeometry());
-        mGrowAnimation->start();
+        animateToIdealGeometry();
     }
-    mState->onAppended();
+    emit idealGeometryChanged();
+}
+
+// Returns the start value an animation at @p progress must have for its
+// current value to be @p current when its end value is @p end
+static int retargetedStart(int current, int end, qreal progress)
+{
+    return qRound((current - end * progress) / (1 - progress));
+}
+
+void NotificationWidget::animateToIdealGeometry()
+{
+    const QRect endRect = idealGeometry();
+    if (mGrowAnimation && mGrowAnimation->state() == QAbstractAnimation::Running) {
+        // Retarget the running animation instead of restarting it, so that
+        // the widget does not stop and start again. Move the start value so
+        // that the current geometry stays on the path to the new end value.
+        const qreal progress = mGrowAnimation->easingCurve().valueForProgress(
+            qreal(mGrowAnimation->currentTime()) / mGrowAnimation->duration());
+        if (progress < .9) {
+            const QRect current = geometry();
+            mGrowAnimation->setStartValue(QRect(
+                retargetedStart(current.x(), endRect.x(), progress),
+                retargetedStart(current.y(), endRect.y(), progress),
+                retargetedStart(current.width(), endRect.width(), progress),
+                retargetedStart(current.height(), endRect.height(), progress)));
+            mGrowAnimation->setEndValue(endRect);
+            return;
+        }
+    }
+    mGrowAnimation.reset(new QPropertyAnimation(this, "geometry"));
+    mGrowAnimation->setEasingCurve(QEasingCurve::OutQuad);
+    mGrowAnimation->setDuration(GROW_ANIMATION_DURATION);
+    mGrowAnimation->setStartValue(geometry());
+    mGrowAnimation->setEndValue(endRect);
+    connect(mGrowAnimation.data(), SIGNAL(finished()), SLOT(slotGrowAnimationFinished()));
+    mGrowAnimation->start();
+}
+
+void NotificationWidget::slotGrowAnimationFinished()
+{
+    // We may have moved under the pointer, or away from it, without it
+    // moving: PointerWatcher would not tell us
+    resumeMouseTracking();
 }
 
 void NotificationWidget::setInputMask()
@@ -348,6 +478,17 @@ void NotificationWidget::setScreen(int screen)
     mScreen = screen;
 }
 
+void NotificationWidget::setStackOffset(int offset)
+{
+    if (mStackOffset == offset) {
+        return;
+    }
+    mStackOffset = offset;
+    if (isVisible()) {
+        animateToIdealGeometry();
+    }
+}
+
 void NotificationWidget::closeWidget()
 {
     mCloseReason = CLOSE_REASON_CLOSED_BY_APP;
@@ -356,14 +497,16 @@ void NotificationWidget::closeWidget()
 
 void NotificationWidget::start()
 {
-    setInputMask();
     if (mScreen == -1) {
         mScreen = QApplication::desktop()->screenNumber(QCursor::pos());
     }
+    if (mRelayoutTimer->isActive()) {
+        relayout();
+    }
     mHLayout->update();
     setGeometry(idealGeometry());
     show();
-    mMousePollTimer->start();
+    startMouseTracking();
     mState->onStarted();
 }
 
@@ -404,19 +547,23 @@ QRect NotificationWidget::idealGeometry() const
     }
     // Compute position
     QRect rect = QApplication::desktop()->availableGeometry(mScreen);
-    {
+    if (!mShadowMarginsValid) {
         int left, top, right, bottom;
-        if (getShadowMargins(winId(), &left, &top, &right, &bottom)) {
-            rect.adjust(left, top, -right, -bottom);
+        mShadowMarginsValid = getShadowMargins(winId(), &left, &top, &right, &bottom);
+        if (mShadowMarginsValid) {
+            mShadowMargins = QMargins(left, top, right, bottom);
         }
     }
+    if (mShadowMarginsValid) {
+        rect.adjust(mShadowMargins.left(), mShadowMargins.top(), -mShadowMargins.right(), -mShadowMargins.bottom());
+    }
     int left, top;
     if (mAlignment & Qt::AlignTop) {
-        top = rect.top();
+        top = rect.top() + mStackOffset;
     } else if (mAlignment & Qt::AlignVCenter) {
-        top = rect.top() + (rect.height() - sh.height()) / 2;
+        top = rect.top() + (rect.height() - sh.height()) / 2 + mStackOffset;
     } else {
-        top = rect.bottom() - sh.height();
+        top = rect.bottom() - sh.height() - mStackOffset;
     }
     if (mAlignment & Qt::AlignLeft) {
         left = rect.left();
@@ -477,10 +624,21 @@ static inline qreal mouseOverOpacityFromPos(const QPoint& pos, const QRect& rect
     #undef returnIfOut
 }
 
+static inline bool isPointerNear(const QPoint& pos, const QRect& rect)
+{
+    return distance(pos.x(), rect.left(), rect.right()) < MOUSE_POLL_NEAR_DISTANCE
+        && distance(pos.y(), rect.top(), rect.bottom()) < MOUSE_POLL_NEAR_DISTANCE;
+}
+
 void NotificationWidget::updateMouseOverOpacity()
+{
+    updateMouseOverOpacity(QCursor::pos());
+}
+
+void NotificationWidget::updateMouseOverOpacity(const QPoint& pos)
 {
     qreal oldOpacity = mMouseOverOpacity;
-    mMouseOverOpacity = mouseOverOpacityFromPos(QCursor::pos(), geometry());
+    mMouseOverOpacity = mouseOverOpacityFromPos(pos, geometry());
 
     bool wasOver = oldOpacity < 1.;
     bool isOver = mMouseOverOpacity < 1.;
@@ -493,10 +651,86 @@ void NotificationWidget::updateMouseOverOpacity()
     if (!qFuzzyCompare(mMouseOverOpacity, oldOpacity)) {
         updateOpacity();
     }
+
+    if (mTrackingMouse && !PointerWatcher::self()->isEventDriven()) {
+        // Schedule next poll: only poll at frame rate if the pointer is close
+        // enough to reach us within a few frames
+        mMousePollTimer->start(isPointerNear(pos, geometry())
+            ? MOUSE_POLL_INTERVAL
+            : MOUSE_POLL_IDLE_INTERVAL);
+    }
+}
+
+void NotificationWidget::startMouseTracking()
+{
+    mTrackingMouse = true;
+    resumeMouseTracking();
+}
+
+void NotificationWidget::stopMouseTracking()
+{
+    mTrackingMouse = false;
+    suspendMouseTracking();
+}
+
+void NotificationWidget::resumeMouseTracking()
+{
+    PointerWatcher* watcher = PointerWatcher::self();
+    if (!mTrackingMouse || watcher->isScreenLocked()) {
+        return;
+    }
+    if (watcher->isEventDriven() && !mWatchingPointer) {
+        mWatchingPointer = true;
+        watcher->acquire();
+        connect(watcher, SIGNAL(pointerMoved(const QPoint&)), SLOT(slotPointerMoved(const QPoint&)));
+    }
+    // The pointer may already be close to us. This also schedules the next
+    // poll if we are not event-driven.
+    updateMouseOverOpacity();
+}
+
+void NotificationWidget::suspendMouseTracking()
+{
+    mMousePollTimer->stop();
+    if (mWatchingPointer) {
+        mWatchingPointer = false;
+        PointerWatcher* watcher = PointerWatcher::self();
+        disconnect(watcher, SIGNAL(pointerMoved(const QPoint&)), this, SLOT(slotPointerMoved(const QPoint&)));
+        watcher->release();
+    }
+}
+
+void NotificationWidget::slotPointerMoved(const QPoint& pos)
+{
+    // PointerWatcher already samples the position once per frame for all
+    // widgets
+    updateMouseOverOpacity(pos);
+}
+
+void NotificationWidget::slotScreenLockChanged(bool locked)
+{
+    // Nobody can see us or move the pointer towards us while the screen is
+    // locked
+    if (locked) {
+        suspendMouseTracking();
+    } else {
+        resumeMouseTracking();
+    }
+}
+
+void NotificationWidget::invalidateShadowMargins()
+{
+    mShadowMarginsValid = false;
+}
+
+void NotificationWidget::emitShown()
+{
+    emit shown(mId);
 }
 
 void NotificationWidget::emitClosed()
 {
+    stopMouseTracking();
     emit closed(mId, mCloseReason);
 }
 
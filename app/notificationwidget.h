@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #define NOTIFICATIONWIDGET_H
 
 // Qt
+#include <QMargins>
 #include <QPropertyAnimation>
 #include <QScopedPointer>
 #include <QWidget>
@@ -46,7 +47,9 @@ class Label;
 namespace Colibri
 {
 
+struct Notification;
 class NotificationWidget;
+class TextWidget;
 
 class State : public QObject
 {
@@ -59,6 +62,12 @@ public:
     virtual void onMouseOver() {}
     virtual void onMouseLeave() {}
 
+    /**
+     * Called when the widget is reused for another notification: the state
+     * must stop affecting the widget and delete itself
+     */
+    void abort();
+
 protected:
     void switchToState(State*);
     NotificationWidget* mNotificationWidget;
@@ -97,22 +106,47 @@ private Q_SLOTS:
 };
 
 /**
- * A widget which shows a notification
+ * A widget which shows a notification.
+ *
+ * Creating the window is expensive, so the widget is meant to be recycled:
+ * call setNotification() to reset it with new content, then start() to show
+ * it.
  */
 class NotificationWidget : public Plasma::Dialog
 {
     Q_OBJECT
 public:
-    NotificationWidget(const QString& appName, uint id, const QImage& image, const QString& appIcon, const QString& summary, const QString& body, int timeout);
+    NotificationWidget();
+    ~NotificationWidget();
 
     Q_PROPERTY(qreal fadeOpacity READ fadeOpacity WRITE setFadeOpacity)
 
+    void setNotification(const Notification&);
+
+    /**
+     * Replaces the icon, for images which arrive after the notification has
+     * been shown
+     */
+    void setPixmap(const QPixmap&);
+
     void start();
 
     void setAlignment(Qt::Alignment);
 
     void setScreen(int);
 
+    /**
+     * Moves the widget away from the screen edge by @p offset pixels, to make
+     * room for other notifications. Animated if the widget is visible.
+     */
+    void setStackOffset(int offset);
+
+    /**
+     * The geometry the widget should have, given its content, alignment and
+     * stack offset
+     */
+    QRect idealGeometry() const;
+
     uint id() const { return mId; }
 
     QString appName() const { return mAppName; }
@@ -123,53 +157,120 @@ public:
 
     QTimeLine* visibleTimeLine() const { return mVisibleTimeLine; }
 
+    bool neverExpires() const { return mNeverExpires; }
+
     void appendToBody(const QString&, int timeout);
 
+    /**
+     * Replaces the summary and the body, for notifications which have been
+     * merged into this one
+     */
+    void setText(const QString& summary, const QString& body);
+
+    /**
+     * Shows that @p count other notifications have been folded into this one
+     */
+    void setFoldedCount(int count);
+
     // Not named close() to avoid confusion with QWidget::close()
     void closeWidget();
 
+    /**
+     * Hides the widget without emitting closed(), so that the notification
+     * can be shown again later
+     */
+    void withdraw();
+
+    /**
+     * How long the notification still has to be shown, in milliseconds.
+     * Meaningless if neverExpires() is true.
+     */
+    int remainingTime() const;
+
     qreal fadeOpacity() const;
     void setFadeOpacity(qreal);
 
+    void emitShown();
+
     void emitClosed();
 
 Q_SIGNALS:
+    /**
+     * Emitted when the widget has finished fading in
+     */
+    void shown(uint id);
+
     void closed(uint id, uint reason);
 
+    /**
+     * Emitted when the content changed size, other widgets may have to move
+     */
+    void idealGeometryChanged();
+
 private Q_SLOTS:
     void updateOpacity();
     void updateMouseOverOpacity();
+    void slotPointerMoved(const QPoint& pos);
+    void slotGrowAnimationFinished();
+    void slotScreenLockChanged(bool);
+    void invalidateShadowMargins();
+    void relayout();
 
 private:
     QString mAppName;
     uint mId;
     QString mSummary;
     QString mBody;
+    // Appended to mBody, but not to mTextLabel yet
+    QString mPendingBody;
     QTimeLine* mVisibleTimeLine;
 
     QGraphicsScene* mScene;
     QGraphicsWidget* mContainer;
     QScopedPointer<HLayout> mHLayout;
     Plasma::Label* mIconLabel;
-    Plasma::Label* mTextLabel;
+    TextWidget* mTextLabel;
     Plasma::FrameSvg* mBackgroundSvg;
 
     uint mCloseReason;
+    bool mNeverExpires;
+    int mFoldedCount;
     Qt::Alignment mAlignment;
     int mScreen;
+    int mStackOffset;
 
     State* mState;
 
     QTimer* mMousePollTimer;
+    // Coalesces appendToBody(), setText() and setFoldedCount() calls
+    QTimer* mRelayoutTimer;
+    // If true, the whole text must be laid out again on the next relayout
+    bool mSummaryChanged;
 
     qreal mFadeOpacity;
     qreal mMouseOverOpacity;
     QScopedPointer<QPropertyAnimation> mGrowAnimation;
 
+    // Looking up the shadow margins requires a round-trip to the X server, so
+    // keep them around
+    mutable QMargins mShadowMargins;
+    mutable bool mShadowMarginsValid;
+
+    // True between start() and close
+    bool mTrackingMouse;
+    // True if connected to PointerWatcher
+    bool mWatchingPointer;
+
     void setInputMask();
+    void updateIconLabel(const QPixmap&);
     void updateTextLabel();
+    void animateToIdealGeometry();
+    void startMouseTracking();
+    void stopMouseTracking();
+    void resumeMouseTracking();
+    void suspendMouseTracking();
+    void updateMouseOverOpacity(const QPoint& pos);
     void adjustSizeAndPosition();
-    QRect idealGeometry() const;
 
     friend class State;
 };
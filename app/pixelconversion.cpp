@@ -0,0 +1,334 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "pixelconversion.h"
+
+// Qt
+#include <QImage>
+#include <QVarLengthArray>
+
+// libc
+#include <string.h>
+
+// Vectorized versions rely on per-function target attributes, so that the
+// rest of the code does not need to be built with -msse2 or -mavx2
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define COLIBRI_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Colibri
+{
+
+namespace PixelConversion
+{
+
+// Returns round(value * alpha / 255)
+static inline uint multiplyByAlpha(uint value, uint alpha)
+{
+    uint t = value * alpha + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static void rgbToXrgbGeneric(QRgb* dst, const uchar* src, int count)
+{
+    const QRgb* end = dst + count;
+    for (; dst != end; ++dst, src += 3) {
+        *dst = qRgb(src[0], src[1], src[2]);
+    }
+}
+
+static void rgbaToPremultipliedArgbGeneric(QRgb* dst, const uchar* src, int count)
+{
+    const QRgb* end = dst + count;
+    for (; dst != end; ++dst, src += 4) {
+        const uint alpha = src[3];
+        *dst = qRgba(
+            multiplyByAlpha(src[0], alpha),
+            multiplyByAlpha(src[1], alpha),
+            multiplyByAlpha(src[2], alpha),
+            alpha);
+    }
+}
+
+#ifdef COLIBRI_X86_SIMD
+
+// Pixels are loaded as little-endian 32 bit integers (0xAABBGGRR), QRgb
+// expects 0xAARRGGBB: swap the red and blue bytes
+__attribute__((target("sse2")))
+static inline __m128i swapRedBlue(__m128i pixels)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    return _mm_or_si128(
+        _mm_and_si128(pixels, _mm_set1_epi32(0xff00ff00)),
+        _mm_or_si128(
+            _mm_slli_epi32(_mm_and_si128(pixels, mask), 16),
+            _mm_and_si128(_mm_srli_epi32(pixels, 16), mask)));
+}
+
+// Multiplies the channels of pixels unpacked to 16 bit per channel by their
+// alpha, using the same rounding as multiplyByAlpha(). Alpha itself is
+// multiplied too and must be restored by the caller.
+__attribute__((target("sse2")))
+static inline __m128i multiplyByAlpha(__m128i pixels)
+{
+    const __m128i alpha = _mm_shufflehi_epi16(
+        _mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)),
+        _MM_SHUFFLE(3, 3, 3, 3));
+    pixels = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(pixels, _mm_srli_epi16(pixels, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void rgbToXrgbSse2(QRgb* dst, const uchar* src, int count)
+{
+    const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+    int pos = 0;
+    // Each iteration reads 16 bytes but only consumes 12 of them
+    for (; pos + 6 <= count; pos += 4, src += 12) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        // Move the 3 bytes of each pixel to the start of a 32 bit lane
+        const __m128i p01 = _mm_unpacklo_epi32(bytes, _mm_srli_si128(bytes, 3));
+        const __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(bytes, 6), _mm_srli_si128(bytes, 9));
+        const __m128i pixels = _mm_unpacklo_epi64(p01, p23);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos),
+            _mm_or_si128(swapRedBlue(pixels), alphaMask));
+    }
+    rgbToXrgbGeneric(dst + pos, src, count - pos);
+}
+
+__attribute__((target("sse2")))
+static void rgbaToPremultipliedArgbSse2(QRgb* dst, const uchar* src, int count)
+{
+    const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+    const __m128i zero = _mm_setzero_si128();
+    int pos = 0;
+    for (; pos + 4 <= count; pos += 4, src += 16) {
+        const __m128i pixels = swapRedBlue(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+        const __m128i low = multiplyByAlpha(_mm_unpacklo_epi8(pixels, zero));
+        const __m128i high = multiplyByAlpha(_mm_unpackhi_epi8(pixels, zero));
+        const __m128i result = _mm_or_si128(
+            _mm_andnot_si128(alphaMask, _mm_packus_epi16(low, high)),
+            _mm_and_si128(pixels, alphaMask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), result);
+    }
+    rgbaToPremultipliedArgbGeneric(dst + pos, src, count - pos);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i swapRedBlue(__m256i pixels)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    return _mm256_or_si256(
+        _mm256_and_si256(pixels, _mm256_set1_epi32(0xff00ff00)),
+        _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(pixels, mask), 16),
+            _mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i multiplyByAlpha(__m256i pixels)
+{
+    const __m256i alpha = _mm256_shufflehi_epi16(
+        _mm256_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)),
+        _MM_SHUFFLE(3, 3, 3, 3));
+    pixels = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alpha), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(pixels, _mm256_srli_epi16(pixels, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void rgbToXrgbAvx2(QRgb* dst, const uchar* src, int count)
+{
+    const __m256i alphaMask = _mm256_set1_epi32(0xff000000);
+    // Moves the 3 bytes of each pixel to the start of a 32 bit lane, in each
+    // 128 bit half
+    const __m256i spread = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    int pos = 0;
+    // Each iteration reads 28 bytes but only consumes 24 of them
+    for (; pos + 10 <= count; pos += 8, src += 24) {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+        __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        pixels = _mm256_shuffle_epi8(pixels, spread);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + pos),
+            _mm256_or_si256(swapRedBlue(pixels), alphaMask));
+    }
+    rgbToXrgbSse2(dst + pos, src, count - pos);
+}
+
+__attribute__((target("avx2")))
+static void rgbaToPremultipliedArgbAvx2(QRgb* dst, const uchar* src, int count)
+{
+    const __m256i alphaMask = _mm256_set1_epi32(0xff000000);
+    const __m256i zero = _mm256_setzero_si256();
+    int pos = 0;
+    for (; pos + 8 <= count; pos += 8, src += 32) {
+        const __m256i pixels = swapRedBlue(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+        // Unpacking and packing both work on each 128 bit half, so pixel order
+        // is preserved
+        const __m256i low = multiplyByAlpha(_mm256_unpacklo_epi8(pixels, zero));
+        const __m256i high = multiplyByAlpha(_mm256_unpackhi_epi8(pixels, zero));
+        const __m256i result = _mm256_or_si256(
+            _mm256_andnot_si256(alphaMask, _mm256_packus_epi16(low, high)),
+            _mm256_and_si256(pixels, alphaMask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + pos), result);
+    }
+    rgbaToPremultipliedArgbSse2(dst + pos, src, count - pos);
+}
+
+#endif // COLIBRI_X86_SIMD
+
+bool getImplementation(Implementation implementation, ConvertFunction* rgbToXrgb, ConvertFunction* rgbaToPremultipliedArgb)
+{
+    switch (implementation) {
+    case GenericImplementation:
+        *rgbToXrgb = rgbToXrgbGeneric;
+        *rgbaToPremultipliedArgb = rgbaToPremultipliedArgbGeneric;
+        return true;
+#ifdef COLIBRI_X86_SIMD
+    case Sse2Implementation:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("sse2")) {
+            return false;
+        }
+        *rgbToXrgb = rgbToXrgbSse2;
+        *rgbaToPremultipliedArgb = rgbaToPremultipliedArgbSse2;
+        return true;
+    case Avx2Implementation:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2")) {
+            return false;
+        }
+        *rgbToXrgb = rgbToXrgbAvx2;
+        *rgbaToPremultipliedArgb = rgbaToPremultipliedArgbAvx2;
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+struct Converters
+{
+    Converters()
+    {
+        // Pick the fastest implementation the CPU supports
+        if (!getImplementation(Avx2Implementation, &rgbToXrgb, &rgbaToPremultipliedArgb)
+            && !getImplementation(Sse2Implementation, &rgbToXrgb, &rgbaToPremultipliedArgb)) {
+            getImplementation(GenericImplementation, &rgbToXrgb, &rgbaToPremultipliedArgb);
+        }
+    }
+
+    ConvertFunction rgbToXrgb;
+    ConvertFunction rgbaToPremultipliedArgb;
+};
+
+static const Converters& converters()
+{
+    static Converters instance;
+    return instance;
+}
+
+void rgbToXrgb(QRgb* dst, const uchar* src, int count)
+{
+    converters().rgbToXrgb(dst, src, count);
+}
+
+void rgbaToPremultipliedArgb(QRgb* dst, const uchar* src, int count)
+{
+    converters().rgbaToPremultipliedArgb(dst, src, count);
+}
+
+// Writes the average of the accumulated pixels to a line of the destination
+// image
+static void flushBox(QRgb* dst, const uint* sums, const uint* columnWeights, int dstWidth, int rowCount)
+{
+    for (int dx = 0; dx < dstWidth; ++dx, sums += 4) {
+        const uint count = columnWeights[dx] * rowCount;
+        const uint half = count / 2;
+        dst[dx] = qRgba(
+            (sums[1] + half) / count,
+            (sums[2] + half) / count,
+            (sums[3] + half) / count,
+            (sums[0] + half) / count);
+    }
+}
+
+void scaleDown(QImage* dst, const uchar* src, int width, int height, int lineCount, int rowStride, ConvertFunction convert)
+{
+    const int dstWidth = dst->width();
+    const int dstHeight = dst->height();
+    Q_ASSERT(dstWidth <= width && dstHeight <= height);
+    if (lineCount < height) {
+        dst->fill(0);
+    }
+    if (lineCount <= 0) {
+        return;
+    }
+
+    QVarLengthArray<QRgb, 2048> line(width);
+    // Maps source columns to destination columns
+    QVarLengthArray<int, 2048> columns(width);
+    // Number of source columns for each destination column
+    QVarLengthArray<uint, 64> columnWeights(dstWidth);
+    // Alpha, red, green and blue sums for each destination column. Pixels are
+    // premultiplied, so averaging them gives correct results with alpha.
+    QVarLengthArray<uint, 256> sums(dstWidth * 4);
+
+    memset(columnWeights.data(), 0, dstWidth * sizeof(uint));
+    for (int x = 0; x < width; ++x) {
+        columns[x] = x * dstWidth / width;
+        ++columnWeights[columns[x]];
+    }
+    memset(sums.data(), 0, sums.size() * sizeof(uint));
+
+    int dy = 0;
+    int rowCount = 0;
+    for (int y = 0; y < lineCount; ++y, src += rowStride) {
+        const int lineDy = y * dstHeight / height;
+        if (lineDy != dy) {
+            flushBox(reinterpret_cast<QRgb*>(dst->scanLine(dy)), sums.constData(), columnWeights.constData(), dstWidth, rowCount);
+            memset(sums.data(), 0, sums.size() * sizeof(uint));
+            dy = lineDy;
+            rowCount = 0;
+        }
+        convert(line.data(), src, width);
+        for (int x = 0; x < width; ++x) {
+            const QRgb pixel = line[x];
+            uint* sum = sums.data() + columns[x] * 4;
+            sum[0] += qAlpha(pixel);
+            sum[1] += qRed(pixel);
+            sum[2] += qGreen(pixel);
+            sum[3] += qBlue(pixel);
+        }
+        ++rowCount;
+    }
+    flushBox(reinterpret_cast<QRgb*>(dst->scanLine(dy)), sums.constData(), columnWeights.constData(), dstWidth, rowCount);
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,89 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef PIXELCONVERSION_H
+#define PIXELCONVERSION_H
+
+// Qt
+#include <QColor>
+
+class QImage;
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+/**
+ * Converters from the pixel layouts used by the image_data hint of the
+ * notification spec to QImage pixels.
+ *
+ * The implementation is picked at runtime depending on the CPU: AVX2, SSE2 or
+ * plain C++.
+ */
+namespace PixelConversion
+{
+
+typedef void (*ConvertFunction)(QRgb* dst, const uchar* src, int count);
+
+/**
+ * Converts @p count pixels from 8 bit R, G, B bytes to Format_RGB32
+ */
+void rgbToXrgb(QRgb* dst, const uchar* src, int count);
+
+/**
+ * Converts @p count pixels from 8 bit R, G, B, A bytes to
+ * Format_ARGB32_Premultiplied
+ */
+void rgbaToPremultipliedArgb(QRgb* dst, const uchar* src, int count);
+
+enum Implementation {
+    GenericImplementation,
+    Sse2Implementation,
+    Avx2Implementation
+};
+
+/**
+ * Stores the converters of @p implementation in @p rgbToXrgb and
+ * @p rgbaToPremultipliedArgb. Returns false if the CPU or the compiler does
+ * not support @p implementation. Only useful to check the implementations
+ * against each other, other code should use the functions above.
+ */
+bool getImplementation(Implementation implementation, ConvertFunction* rgbToXrgb, ConvertFunction* rgbaToPremultipliedArgb);
+
+/**
+ * Converts @p lineCount lines of @p width pixels with @p convert and
+ * box-filters them into @p dst, whose size must be smaller than the source
+ * size. Lines are processed one at a time, so the full size image is never
+ * allocated.
+ *
+ * @p height is the height of the source image, @p lineCount may be less than
+ * that if the source data is truncated. In this case the bottom of @p dst is
+ * left transparent.
+ */
+void scaleDown(QImage* dst, const uchar* src, int width, int height, int lineCount, int rowStride, ConvertFunction convert);
+
+} // namespace
+
+} // namespace
+
+#endif /* PIXELCONVERSION_H */
@@ -0,0 +1,218 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "pointerwatcher.moc"
+
+// Local
+#include <buildconfig.h>
+
+// libc
+#include <string.h>
+
+// X11
+#include <X11/Xlib.h>
+#ifdef HAVE_XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif
+#include <fixx11h.h>
+
+// Qt
+#include <QAbstractEventDispatcher>
+#include <QApplication>
+#include <QCursor>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QTimer>
+#include <QX11Info>
+
+// KDE
+#include <KDebug>
+
+namespace Colibri
+{
+
+static const char* SCREENSAVER_SERVICE = "org.freedesktop.ScreenSaver";
+static const char* SCREENSAVER_PATH = "/ScreenSaver";
+static const char* SCREENSAVER_INTERFACE = "org.freedesktop.ScreenSaver";
+
+// Raw motion events can come at a much higher rate than the screen refresh
+// rate, do not sample the pointer position more than once per frame
+static const int SAMPLE_INTERVAL = 1000 / 60;
+
+static QAbstractEventDispatcher::EventFilter sPreviousEventFilter = 0;
+
+PointerWatcher* PointerWatcher::self()
+{
+    static PointerWatcher* instance = new PointerWatcher(qApp);
+    return instance;
+}
+
+PointerWatcher::PointerWatcher(QObject* parent)
+: QObject(parent)
+, mXInputOpcode(-1)
+, mUserCount(0)
+, mScreenLocked(false)
+, mSampleTimer(new QTimer(this))
+{
+    mSampleTimer->setSingleShot(true);
+    mSampleTimer->setInterval(SAMPLE_INTERVAL);
+    connect(mSampleTimer, SIGNAL(timeout()),
+        SLOT(samplePointerPos()));
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    bus.connect(SCREENSAVER_SERVICE, SCREENSAVER_PATH, SCREENSAVER_INTERFACE,
+        "ActiveChanged", this, SLOT(slotScreenSaverActiveChanged(bool)));
+    QDBusMessage message = QDBusMessage::createMethodCall(
+        SCREENSAVER_SERVICE, SCREENSAVER_PATH, SCREENSAVER_INTERFACE, "GetActive");
+    QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(bus.asyncCall(message), this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+        SLOT(slotGetActiveFinished(QDBusPendingCallWatcher*)));
+
+#ifdef HAVE_XINPUT2
+    Display* display = QX11Info::display();
+    int opcode, event, error;
+    if (!XQueryExtension(display, "XInputExtension", &opcode, &event, &error)) {
+        kDebug() << "No XInput extension, pointer position will be polled";
+        return;
+    }
+    // Before XInput 2.1, raw events are only delivered to the client which
+    // grabbed the device, not to root windows
+    int major = 2, minor = 1;
+    if (XIQueryVersion(display, &major, &minor) != Success || major < 2 || (major == 2 && minor < 1)) {
+        kDebug() << "XInput 2.1 is not available, pointer position will be polled";
+        return;
+    }
+    mXInputOpcode = opcode;
+    sPreviousEventFilter = QAbstractEventDispatcher::instance()->setEventFilter(x11EventFilter);
+#else
+    kDebug() << "Built without XInput 2 support, pointer position will be polled";
+#endif
+}
+
+bool PointerWatcher::isEventDriven() const
+{
+    return mXInputOpcode != -1;
+}
+
+void PointerWatcher::acquire()
+{
+    if (mUserCount++ == 0) {
+        selectMotionEvents(true);
+    }
+}
+
+void PointerWatcher::release()
+{
+    Q_ASSERT(mUserCount > 0);
+    if (--mUserCount == 0) {
+        mSampleTimer->stop();
+        selectMotionEvents(false);
+    }
+}
+
+void PointerWatcher::onMotion()
+{
+    if (mSampleTimer->isActive()) {
+        return;
+    }
+    // We are going to sample the position anyway, no need to wake up for
+    // the next motion events
+    selectMotionEvents(false);
+    mSampleTimer->start();
+}
+
+void PointerWatcher::samplePointerPos()
+{
+    if (mUserCount == 0) {
+        return;
+    }
+    // Select motion events again before sampling, so that we do not miss
+    // motion happening in between
+    selectMotionEvents(true);
+    pointerMoved(QCursor::pos());
+}
+
+bool PointerWatcher::isScreenLocked() const
+{
+    return mScreenLocked;
+}
+
+void PointerWatcher::slotScreenSaverActiveChanged(bool active)
+{
+    if (mScreenLocked == active) {
+        return;
+    }
+    mScreenLocked = active;
+    screenLockChanged(mScreenLocked);
+}
+
+void PointerWatcher::slotGetActiveFinished(QDBusPendingCallWatcher* watcher)
+{
+    QDBusPendingReply<bool> reply = *watcher;
+    watcher->deleteLater();
+    if (reply.isError()) {
+        kDebug() << "Could not get screen saver state:" << reply.error().message();
+        return;
+    }
+    slotScreenSaverActiveChanged(reply.value());
+}
+
+void PointerWatcher::selectMotionEvents(bool enabled)
+{
+#ifdef HAVE_XINPUT2
+    if (!isEventDriven()) {
+        return;
+    }
+    unsigned char bits[XIMaskLen(XI_LASTEVENT)];
+    memset(bits, 0, sizeof(bits));
+    if (enabled) {
+        XISetMask(bits, XI_RawMotion);
+    }
+    XIEventMask mask;
+    mask.deviceid = XIAllMasterDevices;
+    mask.mask_len = sizeof(bits);
+    mask.mask = bits;
+    XISelectEvents(QX11Info::display(), QX11Info::appRootWindow(), &mask, 1);
+    XFlush(QX11Info::display());
+#else
+    Q_UNUSED(enabled);
+#endif
+}
+
+bool PointerWatcher::x11EventFilter(void* message)
+{
+#ifdef HAVE_XINPUT2
+    XEvent* event = static_cast<XEvent*>(message);
+    if (event->type == GenericEvent) {
+        PointerWatcher* watcher = self();
+        // No need to call XGetEventData(), we only care about the event type
+        if (event->xcookie.extension == watcher->mXInputOpcode && event->xcookie.evtype == XI_RawMotion) {
+            watcher->onMotion();
+            return true;
+        }
+    }
+#endif
+    return sPreviousEventFilter ? sPreviousEventFilter(message) : false;
+}
+
+} // namespace
@@ -0,0 +1,98 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef POINTERWATCHER_H
+#define POINTERWATCHER_H
+
+// Qt
+#include <QObject>
+#include <QPoint>
+
+class QDBusPendingCallWatcher;
+class QTimer;
+
+// KDE
+
+// Local
+
+namespace Colibri
+{
+
+/**
+ * Tells when the pointer moves, using XInput 2.1 raw motion events.
+ *
+ * Notification widgets are click-through, so they cannot get mouse events
+ * themselves. Without this they would have to poll the pointer position.
+ *
+ * Motion events are coalesced: the pointer position is sampled at most once
+ * per frame and shared by all users, and no motion event is requested from
+ * the X server until the next sample is due.
+ *
+ * Also tells whether the screen is locked, in which case there is no point
+ * in tracking the pointer at all.
+ */
+class PointerWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    static PointerWatcher* self();
+
+    /**
+     * True if pointerMoved() is going to be emitted. If false, users must
+     * poll the pointer position.
+     */
+    bool isEventDriven() const;
+
+    /**
+     * Motion events are only requested from the X server between the first
+     * acquire() and the last release() calls, so that we do not wake up for
+     * nothing when no notification is visible.
+     */
+    void acquire();
+    void release();
+
+    bool isScreenLocked() const;
+
+Q_SIGNALS:
+    void pointerMoved(const QPoint& pos);
+    void screenLockChanged(bool locked);
+
+private Q_SLOTS:
+    void slotScreenSaverActiveChanged(bool);
+    void slotGetActiveFinished(QDBusPendingCallWatcher*);
+    void samplePointerPos();
+
+private:
+    PointerWatcher(QObject* parent);
+
+    int mXInputOpcode;
+    int mUserCount;
+    bool mScreenLocked;
+    // Started on the first motion event after a sample
+    QTimer* mSampleTimer;
+
+    void selectMotionEvents(bool);
+    void onMotion();
+    static bool x11EventFilter(void* message);
+};
+
+} // namespace
+
+#endif /* POINTERWATCHER_H */
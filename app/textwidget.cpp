@@ -0,0 +1,119 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Self
+#include "textwidget.h"
+#include "textwidget.moc"
+
+// Qt
+#include <QAbstractTextDocumentLayout>
+#include <QFontMetrics>
+#include <QPainter>
+#include <QTextCursor>
+#include <QTextDocument>
+
+// KDE
+#include <Plasma/Theme>
+
+// Local
+
+namespace Colibri
+{
+
+// Text width bounds, in average char widths
+static const int MINIMUM_TEXT_WIDTH = 20;
+static const int MAXIMUM_TEXT_WIDTH = 40;
+
+// Maximum text height, in lines. If the text is longer, only its end is shown.
+static const int MAXIMUM_TEXT_LINES = 15;
+
+TextWidget::TextWidget(QGraphicsItem* parent)
+: QGraphicsWidget(parent)
+, mDocument(new QTextDocument(this))
+{
+    mDocument->setDefaultFont(Plasma::Theme::defaultTheme()->font(Plasma::Theme::DefaultFont));
+    mDocument->setDocumentMargin(0);
+
+    QFontMetrics fm(mDocument->defaultFont());
+    mMinimumTextWidth = MINIMUM_TEXT_WIDTH * fm.averageCharWidth();
+    mMaximumTextWidth = MAXIMUM_TEXT_WIDTH * fm.averageCharWidth();
+    setMinimumHeight(fm.height());
+    setMaximumHeight(MAXIMUM_TEXT_LINES * fm.lineSpacing());
+}
+
+void TextWidget::setText(const QString& summary, const QString& body)
+{
+    mDocument->clear();
+    mDocument->setTextWidth(-1);
+    if (!summary.isEmpty()) {
+        QTextCursor cursor(mDocument);
+        cursor.insertHtml("<b>" + summary + "</b>");
+    }
+    if (!body.isEmpty()) {
+        insertBody(body);
+    }
+    // This lays out the whole document, but only once per notification
+    const qreal width = mDocument->idealWidth();
+    mDocument->setTextWidth(qBound(qreal(mMinimumTextWidth), width, qreal(mMaximumTextWidth)));
+    updateSize();
+}
+
+void TextWidget::appendBody(const QString& body)
+{
+    insertBody(body);
+    // The layout only processes the blocks which changed
+    updateSize();
+}
+
+void TextWidget::insertBody(const QString& body)
+{
+    QTextCursor cursor(mDocument);
+    cursor.movePosition(QTextCursor::End);
+    if (!mDocument->isEmpty()) {
+        cursor.insertBlock();
+    }
+    cursor.insertHtml(body);
+}
+
+void TextWidget::updateSize()
+{
+    // resize() bounds the height to maximumHeight()
+    const QSizeF size = mDocument->documentLayout()->documentSize();
+    setPreferredSize(size);
+    resize(size);
+    update();
+}
+
+void TextWidget::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
+{
+    // Show the end of the text, this is where appended text goes. Only the
+    // blocks intersecting the clip rect are drawn.
+    const qreal offset = mDocument->documentLayout()->documentSize().height() - size().height();
+    QAbstractTextDocumentLayout::PaintContext ctx;
+    ctx.palette.setColor(QPalette::Text, Plasma::Theme::defaultTheme()->color(Plasma::Theme::TextColor));
+    ctx.clip = boundingRect().translated(0, offset);
+    painter->save();
+    painter->setClipRect(boundingRect());
+    painter->translate(0, -offset);
+    mDocument->documentLayout()->draw(painter, ctx);
+    painter->restore();
+}
+
+} // namespace
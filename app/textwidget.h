@@ -0,0 +1,75 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+#ifndef TEXTWIDGET_H
+#define TEXTWIDGET_H
+
+// Qt
+#include <QGraphicsWidget>
+
+// KDE
+
+// Local
+
+class QTextDocument;
+
+namespace Colibri
+{
+
+/**
+ * Shows the summary and body of a notification.
+ *
+ * The widget height is bounded: if the text is too long, only its end is
+ * shown.
+ *
+ * The text is kept in a QTextDocument, with one block per appended body, so
+ * that appending only requires laying out the new blocks instead of parsing
+ * and laying out the whole text again.
+ */
+class TextWidget : public QGraphicsWidget
+{
+    Q_OBJECT
+public:
+    TextWidget(QGraphicsItem* parent = 0);
+
+    /**
+     * Replaces the content of the widget. Picks the text width.
+     */
+    void setText(const QString& summary, const QString& body);
+
+    /**
+     * Adds @p body as a new block. The text width does not change.
+     */
+    void appendBody(const QString& body);
+
+    virtual void paint(QPainter*, const QStyleOptionGraphicsItem*, QWidget*);
+
+private:
+    QTextDocument* mDocument;
+    int mMinimumTextWidth;
+    int mMaximumTextWidth;
+
+    void insertBody(const QString& body);
+    void updateSize();
+};
+
+} // namespace
+
+#endif /* TEXTWIDGET_H */
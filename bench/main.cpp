@@ -0,0 +1,383 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// libc
+#include <stdio.h>
+#include <unistd.h>
+
+// Qt
+#include <QCoreApplication>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusReply>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+
+// KDE
+
+// Local
+
+/*
+ * colibri-bench: replays synthetic notification workloads against the
+ * notification server running on the session bus, and reports throughput,
+ * Notify() latency, CPU time per notification and peak RSS of the server.
+ *
+ * Notify() only queues the notification, so each workload waits for all its
+ * notifications to be closed before sampling the CPU time of the server.
+ * Colibri also reports how long notifications waited in its queue and how
+ * long they took to be fully visible.
+ *
+ * It is meant to be run on a private bus and display, see run-bench.sh.
+ */
+
+static const char* SERVICE = "org.freedesktop.Notifications";
+static const char* PATH = "/org/freedesktop/Notifications";
+static const char* INTERFACE = "org.freedesktop.Notifications";
+
+static const int DEFAULT_COUNT = 200;
+
+// How long we wait for the notifications of a workload to be closed, in
+// seconds
+static const int DEFAULT_DRAIN_TIMEOUT = 300;
+
+struct Workload
+{
+    const char* name;
+    const char* description;
+    // Fills the arguments of the Notify() call for notification @p index
+    void (*fill)(int index, QString* appName, QString* summary, QString* body, QVariantMap* hints);
+};
+
+static void fillBurst(int index, QString* appName, QString* summary, QString* body, QVariantMap*)
+{
+    *appName = "burst";
+    *summary = QString("Build %1 finished").arg(index);
+    *body = "All tests <b>passed</b>";
+}
+
+static void fillLongText(int index, QString* appName, QString* summary, QString* body, QVariantMap*)
+{
+    static QString text;
+    if (text.isEmpty()) {
+        const QString sentence = "Lorem ipsum dolor sit amet, <i>consectetur</i> adipiscing elit.\n";
+        while (text.length() < 64 * 1024) {
+            text += sentence;
+        }
+    }
+    *appName = "longtext";
+    *summary = QString("Log excerpt %1").arg(index);
+    *body = text;
+}
+
+static void fillImage(int index, QString* appName, QString* summary, QString* body, QVariantMap* hints)
+{
+    const int size = 1024;
+    static QByteArray pixels;
+    if (pixels.isEmpty()) {
+        pixels.resize(size * size * 4);
+        for (int idx = 0; idx < pixels.size(); ++idx) {
+            pixels[idx] = char(idx * 7);
+        }
+    }
+    // Change one pixel so that the server cannot use its image cache
+    QByteArray data = pixels;
+    data[0] = char(index);
+
+    QDBusArgument arg;
+    arg.beginStructure();
+    arg << size << size << size * 4 << true << 8 << 4 << data;
+    arg.endStructure();
+    hints->insert("image_data", QVariant::fromValue(arg));
+
+    *appName = "image";
+    *summary = QString("Photo %1").arg(index);
+    *body = "1024x1024 RGBA";
+}
+
+static void fillManyApps(int index, QString* appName, QString* summary, QString* body, QVariantMap*)
+{
+    *appName = QString("app%1").arg(index % 50);
+    *summary = QString("Message %1").arg(index);
+    *body = "Hello";
+}
+
+static void fillAppend(int index, QString* appName, QString* summary, QString* body, QVariantMap*)
+{
+    // Same app and summary: the server appends the bodies
+    *appName = "chat";
+    *summary = "Annoying Person says";
+    *body = QString("Line %1, pressing Enter every 5 words!").arg(index);
+}
+
+static const Workload WORKLOADS[] = {
+    { "burst", "many short notifications from one app", fillBurst },
+    { "longtext", "64 kB bodies", fillLongText },
+    { "image", "1024x1024 image_data hints", fillImage },
+    { "apps", "notifications from 50 apps", fillManyApps },
+    { "append", "bodies appended to the same notification", fillAppend },
+};
+static const int WORKLOAD_COUNT = sizeof(WORKLOADS) / sizeof(Workload);
+
+/**
+ * Returns utime + stime of @p pid, in seconds
+ */
+static double cpuTime(uint pid)
+{
+    QFile file(QString("/proc/%1/stat").arg(pid));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    // Skip "pid (comm)", comm may contain spaces
+    const QByteArray stat = file.readAll();
+    const QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 13) {
+        return 0;
+    }
+    // utime and stime are fields 14 and 15 of the file
+    const qint64 ticks = fields.at(11).toLongLong() + fields.at(12).toLongLong();
+    return double(ticks) / sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * Returns the peak RSS of @p pid, in kB
+ */
+static int peakRss(uint pid)
+{
+    QFile file(QString("/proc/%1/status").arg(pid));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    Q_FOREACH(const QByteArray& line, file.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:")) {
+            return line.mid(6).trimmed().split(' ').first().toInt();
+        }
+    }
+    return 0;
+}
+
+/**
+ * Records the ids of closed notifications, and tells when all the
+ * notifications we are waiting for have been closed
+ */
+class ClosedWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    ClosedWatcher()
+    {
+        QDBusConnection::sessionBus().connect(SERVICE, PATH, INTERFACE, "NotificationClosed",
+            this, SLOT(slotNotificationClosed(uint, uint)));
+    }
+
+    void clear()
+    {
+        mClosedIds.clear();
+        mWaitedIds.clear();
+    }
+
+    /**
+     * Returns true if all notifications in @p ids have been closed before
+     * @p timeout seconds
+     */
+    bool waitForClosed(const QList<uint>& ids, int timeout)
+    {
+        mWaitedIds = ids.toSet() - mClosedIds;
+        if (mWaitedIds.isEmpty()) {
+            return true;
+        }
+        QEventLoop loop;
+        connect(this, SIGNAL(allClosed()), &loop, SLOT(quit()));
+        QTimer::singleShot(timeout * 1000, &loop, SLOT(quit()));
+        loop.exec();
+        return mWaitedIds.isEmpty();
+    }
+
+Q_SIGNALS:
+    void allClosed();
+
+private Q_SLOTS:
+    void slotNotificationClosed(uint id, uint)
+    {
+        mClosedIds << id;
+        if (mWaitedIds.remove(id) && mWaitedIds.isEmpty()) {
+            emit allClosed();
+        }
+    }
+
+private:
+    QSet<uint> mClosedIds;
+    QSet<uint> mWaitedIds;
+};
+
+static QString callColibri(const char* method)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(SERVICE, PATH, "org.kde.Colibri", method);
+    QDBusMessage reply = QDBusConnection::sessionBus().call(message);
+    if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().isEmpty()) {
+        return QString();
+    }
+    return reply.arguments().first().toString();
+}
+
+/**
+ * Prints the lines of the GetStatistics() table for @p stages
+ */
+static void printServerStatistics(const QStringList& stages)
+{
+    const QString statistics = callColibri("GetStatistics");
+    Q_FOREACH(const QString& line, statistics.split('\n')) {
+        const QString stage = line.section(' ', 0, 0);
+        if (stage == "stage" || stages.contains(stage)) {
+            printf("    %s\n", qPrintable(line));
+        }
+    }
+}
+
+static double percentile(QVector<qint64> values, int percent)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    qSort(values);
+    const int idx = qMin(values.size() - 1, (values.size() * percent + 99) / 100 - 1);
+    return values.at(qMax(idx, 0)) / 1000.;
+}
+
+static bool runWorkload(const Workload& workload, int count, int drainTimeout, uint pid, ClosedWatcher* watcher)
+{
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QVector<qint64> latencies;
+    latencies.reserve(count);
+    QList<uint> ids;
+
+    callColibri("ResetStatistics");
+    watcher->clear();
+    const double cpuStart = cpuTime(pid);
+    QElapsedTimer wallTimer;
+    wallTimer.start();
+    for (int index = 0; index < count; ++index) {
+        QString appName, summary, body;
+        QVariantMap hints;
+        workload.fill(index, &appName, &summary, &body, &hints);
+
+        QDBusMessage message = QDBusMessage::createMethodCall(SERVICE, PATH, INTERFACE, "Notify");
+        message << appName << uint(0) << QString() << summary << body << QStringList()
+            << hints << -1;
+        QElapsedTimer callTimer;
+        callTimer.start();
+        QDBusMessage reply = bus.call(message);
+        latencies << callTimer.nsecsElapsed() / 1000;
+        if (reply.type() != QDBusMessage::ReplyMessage) {
+            fprintf(stderr, "Notify() failed: %s\n", qPrintable(reply.errorMessage()));
+            return false;
+        }
+        ids << reply.arguments().first().toUInt();
+    }
+    const qint64 wallTime = wallTimer.elapsed();
+
+    // The server has only queued the notifications so far, wait for it to
+    // be done with them
+    const bool drained = watcher->waitForClosed(ids, drainTimeout);
+    const double cpu = cpuTime(pid) - cpuStart;
+
+    printf("%-9s %6d %10.0f %9.3f %9.3f %9.3f %10.3f\n",
+        workload.name,
+        count,
+        wallTime > 0 ? count * 1000. / wallTime : 0.,
+        percentile(latencies, 50),
+        percentile(latencies, 95),
+        percentile(latencies, 99),
+        cpu * 1000. / count);
+    if (!drained) {
+        printf("    not all notifications were closed after %d s, cpu time is incomplete\n", drainTimeout);
+    }
+    printServerStatistics(QStringList() << "queue" << "total");
+    fflush(stdout);
+
+    // Empty the queue before the next workload
+    Q_FOREACH(uint id, ids) {
+        QDBusMessage message = QDBusMessage::createMethodCall(SERVICE, PATH, INTERFACE, "CloseNotification");
+        message << id;
+        bus.call(message);
+    }
+    return true;
+}
+
+static void usage()
+{
+    printf("Usage: colibri-bench [--count N] [--drain-timeout SECONDS] [workload...]\n\nWorkloads:\n");
+    for (int idx = 0; idx < WORKLOAD_COUNT; ++idx) {
+        printf("  %-9s %s\n", WORKLOADS[idx].name, WORKLOADS[idx].description);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int count = DEFAULT_COUNT;
+    int drainTimeout = DEFAULT_DRAIN_TIMEOUT;
+    QStringList names;
+    QStringList args = app.arguments().mid(1);
+    while (!args.isEmpty()) {
+        const QString arg = args.takeFirst();
+        if (arg == "--count" && !args.isEmpty()) {
+            count = args.takeFirst().toInt();
+        } else if (arg == "--drain-timeout" && !args.isEmpty()) {
+            drainTimeout = args.takeFirst().toInt();
+        } else if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        } else {
+            names << arg;
+        }
+    }
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QDBusReply<uint> pidReply = bus.interface()->servicePid(SERVICE);
+    if (!pidReply.isValid()) {
+        fprintf(stderr, "No notification server running: %s\n", qPrintable(pidReply.error().message()));
+        return 1;
+    }
+    const uint pid = pidReply.value();
+    ClosedWatcher watcher;
+
+    printf("%-9s %6s %10s %9s %9s %9s %10s\n",
+        "workload", "count", "notif/s", "call p50", "call p95", "call p99", "cpu ms/n");
+    for (int idx = 0; idx < WORKLOAD_COUNT; ++idx) {
+        if (!names.isEmpty() && !names.contains(WORKLOADS[idx].name)) {
+            continue;
+        }
+        if (!runWorkload(WORKLOADS[idx], count, drainTimeout, pid, &watcher)) {
+            return 1;
+        }
+    }
+    printf("\npeak RSS: %d kB\n", peakRss(pid));
+    return 0;
+}
+
+#include "main.moc"
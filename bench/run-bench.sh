@@ -0,0 +1,48 @@
+#!/bin/sh
+# Runs colibri-bench against a colibri instance started on a private X display
+# and D-Bus session, so that it can run without a desktop, for example in CI.
+#
+# Usage: run-bench.sh <build dir> [colibri-bench arguments]
+set -e
+
+if [ -z "$1" ] ; then
+    echo "Usage: $0 <build dir> [colibri-bench arguments]" >&2
+    exit 1
+fi
+BUILD_DIR=$(cd "$1" && pwd)
+shift
+
+if [ -z "$IN_PRIVATE_SESSION" ] ; then
+    export IN_PRIVATE_SESSION=1
+    exec xvfb-run --auto-servernum --server-args="-screen 0 1280x1024x24" \
+        dbus-run-session -- "$0" "$BUILD_DIR" "$@"
+fi
+
+# Do not use the configuration of the user. The workloads send notifications
+# which only differ by numbers, as fast as possible: merging and rate limiting
+# would fold most of them. colibri-bench waits for all notifications to be
+# closed, show them for a short time.
+export KDEHOME=$(mktemp -d)
+mkdir -p "$KDEHOME/share/config"
+cat > "$KDEHOME/share/config/colibrirc" <<EOF
+[General]
+MergeSimilarNotifications=false
+RateLimitPerMinute=0
+MaxVisibleNotifications=10
+MinTimeout=100
+MaxTimeout=500
+EOF
+
+"$BUILD_DIR/app/colibri" --stats &
+COLIBRI_PID=$!
+trap 'kill $COLIBRI_PID 2>/dev/null; rm -rf "$KDEHOME"' EXIT
+
+# Wait for colibri to register on the bus
+for i in $(seq 50) ; do
+    if qdbus org.freedesktop.Notifications > /dev/null 2>&1 ; then
+        break
+    fi
+    sleep 0.1
+done
+
+"$BUILD_DIR/bench/colibri-bench" "$@"
@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 // Qt
 #include <QDBusConnectionInterface>
 #include <QDBusInterface>
+#include <QDBusMessage>
 #include <QDBusServiceWatcher>
 #include <QDBusReply>
 #include <QDesktopWidget>
@@ -109,6 +110,10 @@ void ControlModule::save()
     mConfig->setScreen(screen);
     mConfig->writeConfig();
     KCModule::save();
+
+    // Colibri does not watch its config file, tell it to read it again
+    QDBusMessage message = QDBusMessage::createMethodCall(DBUS_SERVICE, DBUS_PATH, "org.kde.Colibri", "ReloadConfig");
+    QDBusConnection::sessionBus().send(message);
 }
 
 void ControlModule::defaults()
@@ -0,0 +1,100 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Qt
+
+// KDE
+#include <qtest_kde.h>
+
+// Local
+#include <bodysanitizer.h>
+
+using namespace Colibri;
+
+class BodySanitizerTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testSanitize_data();
+    void testSanitize();
+};
+
+QTEST_KDEMAIN_CORE(BodySanitizerTest)
+
+void BodySanitizerTest::testSanitize_data()
+{
+    QTest::addColumn<QString>("body");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("empty") << "" << "";
+    QTest::newRow("plain") << "plain text" << "<div>plain text</div>";
+    QTest::newRow("wrapper") << "<qt>Hello <b>world</b></qt>" << "<div>Hello <b>world</b></div>";
+    QTest::newRow("wrapper-uppercase") << "<HTML><BODY>Up</BODY></HTML>" << "<div>Up</div>";
+    QTest::newRow("newlines") << "line1\nline2\r\n" << "<div>line1<br>line2<br></div>";
+    QTest::newRow("br") << "<br/>x<br>" << "<div><br>x<br></div>";
+    QTest::newRow("stray-chars") << "a < b && c > d" << "<div>a &lt; b &amp;&amp; c &gt; d</div>";
+    QTest::newRow("entities")
+        << "&amp; &#123; &#xFf; &bogus &;"
+        << "<div>&amp; &#123; &#xFf; &amp;bogus &amp;;</div>";
+    QTest::newRow("unknown-tag")
+        << "<script>alert(1)</script>"
+        << "<div>&lt;script&gt;alert(1)&lt;/script&gt;</div>";
+    QTest::newRow("space-before-name") << "< b>" << "<div>&lt; b&gt;</div>";
+    QTest::newRow("a")
+        << "<a href='http://x?a=1&b=\"2\"' onclick=evil>link</a>"
+        << "<div><a href=\"http://x?a=1&amp;b=&quot;2&quot;\">link</a></div>";
+    QTest::newRow("img")
+        << "<img src=\"a.png\" width=99999 alt=A/>"
+        << "<div><img src=\"a.png\" alt=\"A/\"></div>";
+    QTest::newRow("unclosed") << "<b><i>unclosed" << "<div><b><i>unclosed</i></b></div>";
+    QTest::newRow("stray-closing") << "</b>stray<i>x</b>y" << "<div>stray<i>xy</i></div>";
+    QTest::newRow("too-deep")
+        << "<b><b><b><b><b><b><b><b><b><b>deep</b></b></b></b></b></b></b></b></b></b>after"
+        << "<div><b><b><b><b><b><b><b><b>deep</b></b></b></b></b></b></b></b>after</div>";
+
+    // Unterminated tags are shown as text
+    QTest::newRow("unterminated-value")
+        << "<a href=\"unterminated>x"
+        << "<div>&lt;a href=\"unterminated&gt;x</div>";
+    QTest::newRow("unterminated-unknown-attribute")
+        << "<b x=\"unterminated>x"
+        << "<div>&lt;b x=\"unterminated&gt;x</div>";
+    QTest::newRow("repeated-unterminated-values")
+        << QString("<a href=\"").repeated(1000)
+        << "<div>" + QString("&lt;a href=\"").repeated(1000) + "</div>";
+    QTest::newRow("repeated-unterminated-values-quote-at-end")
+        << QString("<b x=\"").repeated(1000) + '"'
+        << "<div>" + QString("&lt;b x=\"").repeated(1000) + "\"</div>";
+
+    // Values longer than MAX_TAG_LENGTH are not looked at
+    const QString longValue(BodySanitizer::MAX_TAG_LENGTH, 'x');
+    QTest::newRow("too-long")
+        << "<a href=\"" + longValue + "\">link</a>"
+        << "<div>&lt;a href=\"" + longValue + "\"&gt;link</div>";
+}
+
+void BodySanitizerTest::testSanitize()
+{
+    QFETCH(QString, body);
+    QFETCH(QString, expected);
+    QCOMPARE(BodySanitizer::sanitize(body), expected);
+}
+
+#include "bodysanitizertest.moc"
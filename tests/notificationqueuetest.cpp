@@ -0,0 +1,186 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Qt
+#include <QStringList>
+
+// KDE
+#include <qtest_kde.h>
+
+// Local
+#include <notificationqueue.h>
+
+using namespace Colibri;
+
+class NotificationQueueTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testEmpty();
+    void testPriorityOrder();
+    void testRequeue();
+    void testInsert();
+    void testRemoveOne();
+    void testEvictionCandidate_data();
+    void testEvictionCandidate();
+};
+
+// Notification contains a QPixmap, which needs a GUI application
+QTEST_KDEMAIN(NotificationQueueTest, GUI)
+
+static QList<uint> takeAll(NotificationQueue* queue)
+{
+    QList<uint> ids;
+    while (!queue->isEmpty()) {
+        ids << queue->takeHead();
+    }
+    return ids;
+}
+
+void NotificationQueueTest::testEmpty()
+{
+    NotificationQueue queue;
+    QVERIFY(queue.isEmpty());
+    QCOMPARE(queue.size(), 0);
+    QVERIFY(!queue.contains(1));
+    // Removing an id which is not queued must not do anything
+    queue.removeOne(1);
+    QVERIFY(queue.isEmpty());
+}
+
+void NotificationQueueTest::testPriorityOrder()
+{
+    NotificationQueue queue;
+    queue.enqueue(1, URGENCY_LOW);
+    queue.enqueue(2, URGENCY_NORMAL);
+    queue.enqueue(3, URGENCY_CRITICAL);
+    queue.enqueue(4, URGENCY_NORMAL);
+    queue.enqueue(5, URGENCY_LOW);
+    queue.enqueue(6, URGENCY_CRITICAL);
+    QCOMPARE(queue.size(), 6);
+    QCOMPARE(queue.level(URGENCY_LOW), QList<uint>() << 1 << 5);
+    QCOMPARE(queue.level(URGENCY_NORMAL), QList<uint>() << 2 << 4);
+    QCOMPARE(queue.level(URGENCY_CRITICAL), QList<uint>() << 3 << 6);
+
+    // Most urgent first, then in arrival order
+    QCOMPARE(queue.head(), 3u);
+    QCOMPARE(takeAll(&queue), QList<uint>() << 3 << 6 << 2 << 4 << 1 << 5);
+    QCOMPARE(queue.size(), 0);
+    QVERIFY(!queue.contains(3));
+}
+
+void NotificationQueueTest::testRequeue()
+{
+    NotificationQueue queue;
+    queue.enqueue(1, URGENCY_LOW);
+    queue.enqueue(2, URGENCY_NORMAL);
+    queue.enqueue(3, URGENCY_NORMAL);
+
+    // A preempted notification gets its place back, but stays behind more
+    // urgent ones
+    const uint shown = queue.takeHead();
+    QCOMPARE(shown, 2u);
+    queue.enqueue(4, URGENCY_CRITICAL);
+    queue.requeue(shown, URGENCY_NORMAL);
+    QVERIFY(queue.contains(shown));
+    QCOMPARE(queue.size(), 4);
+    QCOMPARE(takeAll(&queue), QList<uint>() << 4 << 2 << 3 << 1);
+}
+
+void NotificationQueueTest::testInsert()
+{
+    NotificationQueue queue;
+    queue.enqueue(1, URGENCY_NORMAL);
+    queue.enqueue(2, URGENCY_NORMAL);
+    queue.insert(URGENCY_NORMAL, 1, 3);
+    queue.insert(URGENCY_LOW, 0, 4);
+    QCOMPARE(queue.size(), 4);
+    QVERIFY(queue.contains(3));
+    QCOMPARE(takeAll(&queue), QList<uint>() << 1 << 3 << 2 << 4);
+}
+
+void NotificationQueueTest::testRemoveOne()
+{
+    NotificationQueue queue;
+    queue.enqueue(1, URGENCY_LOW);
+    queue.enqueue(2, URGENCY_NORMAL);
+    queue.enqueue(3, URGENCY_CRITICAL);
+
+    queue.removeOne(2);
+    QVERIFY(!queue.contains(2));
+    QCOMPARE(queue.size(), 2);
+    QVERIFY(queue.level(URGENCY_NORMAL).isEmpty());
+
+    // Already removed
+    queue.removeOne(2);
+    QCOMPARE(queue.size(), 2);
+
+    queue.removeOne(3);
+    QCOMPARE(queue.head(), 1u);
+    QCOMPARE(takeAll(&queue), QList<uint>() << 1);
+}
+
+Q_DECLARE_METATYPE(Colibri::NotificationQueue::EvictionPolicy)
+
+void NotificationQueueTest::testEvictionCandidate_data()
+{
+    // Each notification is described as "<appName><urgency>", ids start at 1
+    QTest::addColumn<QStringList>("notifications");
+    QTest::addColumn<NotificationQueue::EvictionPolicy>("policy");
+    QTest::addColumn<uint>("expected");
+
+    const QStringList mixed = QStringList() << "a1" << "b0" << "c0" << "c0" << "a0";
+    QTest::newRow("oldest-low") << mixed << NotificationQueue::OldestLowUrgency << 2u;
+    QTest::newRow("noisiest-low") << mixed << NotificationQueue::NoisiestApp << 3u;
+
+    const QStringList tie = QStringList() << "a0" << "b0" << "b0" << "a0";
+    QTest::newRow("noisiest-tie") << tie << NotificationQueue::NoisiestApp << 2u;
+
+    // Less urgent notifications go first, even if their app is quieter
+    const QStringList normal = QStringList() << "a1" << "a1" << "b0" << "a1";
+    QTest::newRow("noisiest-normal") << normal << NotificationQueue::NoisiestApp << 3u;
+
+    // Critical notifications are only evicted if there is nothing else
+    const QStringList critical = QStringList() << "a2" << "b2" << "b2";
+    QTest::newRow("oldest-critical") << critical << NotificationQueue::OldestLowUrgency << 1u;
+    QTest::newRow("noisiest-critical") << critical << NotificationQueue::NoisiestApp << 2u;
+}
+
+void NotificationQueueTest::testEvictionCandidate()
+{
+    QFETCH(QStringList, notifications);
+    QFETCH(NotificationQueue::EvictionPolicy, policy);
+    QFETCH(uint, expected);
+
+    NotificationQueue queue;
+    QHash<uint, Notification> notificationForId;
+    uint id = 1;
+    Q_FOREACH(const QString& description, notifications) {
+        Notification notification;
+        notification.id = id++;
+        notification.appName = description.left(1);
+        notification.urgency = description.mid(1).toInt();
+        notificationForId.insert(notification.id, notification);
+        queue.enqueue(notification.id, notification.urgency);
+    }
+    QCOMPARE(queue.findEvictionCandidate(notificationForId, policy), expected);
+}
+
+#include "notificationqueuetest.moc"
@@ -0,0 +1,111 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// Qt
+
+// KDE
+#include <qtest_kde.h>
+
+// Local
+#include <notificationtext.h>
+
+using namespace Colibri;
+
+class NotificationTextTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testFingerprint_data();
+    void testFingerprint();
+    void testTruncateBody_data();
+    void testTruncateBody();
+};
+
+QTEST_KDEMAIN_CORE(NotificationTextTest)
+
+void NotificationTextTest::testFingerprint_data()
+{
+    QTest::addColumn<QString>("summary1");
+    QTest::addColumn<QString>("body1");
+    QTest::addColumn<QString>("summary2");
+    QTest::addColumn<QString>("body2");
+    QTest::addColumn<bool>("similar");
+
+    QTest::newRow("identical") << "Build failed" << "foo" << "Build failed" << "foo" << true;
+    QTest::newRow("numbers") << "Build #1234 failed" << "" << "Build #99 failed" << "" << true;
+    QTest::newRow("numbers-in-body") << "Mail" << "3 new mails" << "Mail" << "12 new mails" << true;
+    QTest::newRow("case") << "Build Failed" << "" << "BUILD failed" << "" << true;
+    QTest::newRow("whitespace") << "Build  failed" << "a\n b" << "Build\tfailed" << "a b" << true;
+
+    QTest::newRow("number-vs-none") << "Build 1 failed" << "" << "Build failed" << "" << false;
+    QTest::newRow("two-numbers-vs-one") << "1.2" << "" << "12" << "" << false;
+    QTest::newRow("space-vs-none") << "Buildfailed" << "" << "Build failed" << "" << false;
+    QTest::newRow("words") << "Build failed" << "" << "Build passed" << "" << false;
+    // Text must not move between the summary and the body
+    QTest::newRow("summary-body-boundary") << "Build failed" << "" << "Build" << "failed" << false;
+    QTest::newRow("body") << "Build failed" << "foo" << "Build failed" << "bar" << false;
+}
+
+void NotificationTextTest::testFingerprint()
+{
+    QFETCH(QString, summary1);
+    QFETCH(QString, body1);
+    QFETCH(QString, summary2);
+    QFETCH(QString, body2);
+    QFETCH(bool, similar);
+
+    const uint fingerprint1 = NotificationText::fingerprint(summary1, body1);
+    const uint fingerprint2 = NotificationText::fingerprint(summary2, body2);
+    QVERIFY(fingerprint1 != 0);
+    QVERIFY(fingerprint2 != 0);
+    QCOMPARE(fingerprint1 == fingerprint2, similar);
+}
+
+void NotificationTextTest::testTruncateBody_data()
+{
+    QTest::addColumn<QString>("body");
+    QTest::addColumn<int>("maxLength");
+    QTest::addColumn<QString>("expected");
+
+    const QString ellipsis = QChar(0x2026);
+    QTest::newRow("short") << "short" << 10 << "short";
+    QTest::newRow("exact") << "exact" << 5 << "exact";
+    QTest::newRow("plain") << "abcdef" << 3 << "abc" + ellipsis;
+    QTest::newRow("zero") << "abc" << 0 << ellipsis;
+    QTest::newRow("negative") << "abc" << -5 << ellipsis;
+
+    QTest::newRow("in-tag") << "ab<b>cd</b>" << 4 << "ab" + ellipsis;
+    QTest::newRow("after-tag") << "ab<b>cd</b>" << 6 << "ab<b>c" + ellipsis;
+    QTest::newRow("in-entity") << "a &amp; b" << 4 << "a " + ellipsis;
+    QTest::newRow("after-entity") << "a &amp; b" << 7 << "a &amp;" + ellipsis;
+    QTest::newRow("only-entity") << "&amp;" << 3 << ellipsis;
+    QTest::newRow("entity-in-tag") << "<a href=\"x&amp;y\">z</a>" << 12 << ellipsis;
+    QTest::newRow("entity-after-tag") << "x<b>&lt;</b>" << 6 << "x<b>" + ellipsis;
+}
+
+void NotificationTextTest::testTruncateBody()
+{
+    QFETCH(QString, body);
+    QFETCH(int, maxLength);
+    QFETCH(QString, expected);
+    QCOMPARE(NotificationText::truncateBody(body, maxLength), expected);
+}
+
+#include "notificationtexttest.moc"
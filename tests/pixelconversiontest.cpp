@@ -0,0 +1,221 @@
+// vim: set tabstop=4 shiftwidth=4 expandtab:
+/*
+Colibri: Light notification system for KDE4
+Copyright 2013 Aurélien Gâteau <agateau@kde.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA.
+
+*/
+// libc
+#include <string.h>
+
+// Qt
+#include <QImage>
+#include <QVector>
+
+// KDE
+#include <qtest_kde.h>
+
+// Local
+#include <pixelconversion.h>
+
+using namespace Colibri;
+
+Q_DECLARE_METATYPE(Colibri::PixelConversion::Implementation)
+
+/**
+ * Checks the vectorized converters against the generic ones
+ */
+class PixelConversionTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testConvert_data();
+    void testConvert();
+    void testScaleDown_data();
+    void testScaleDown();
+};
+
+QTEST_KDEMAIN_CORE(PixelConversionTest)
+
+// Written after the converted pixels, to catch overflows
+static const QRgb GUARD = 0xdeadbeef;
+
+static QByteArray randomBytes(int size)
+{
+    QByteArray bytes(size, 0);
+    for (int idx = 0; idx < size; ++idx) {
+        bytes[idx] = char(qrand());
+    }
+    return bytes;
+}
+
+static PixelConversion::ConvertFunction convertFunction(PixelConversion::Implementation implementation, int channels)
+{
+    PixelConversion::ConvertFunction rgbToXrgb, rgbaToPremultipliedArgb;
+    if (!PixelConversion::getImplementation(implementation, &rgbToXrgb, &rgbaToPremultipliedArgb)) {
+        return 0;
+    }
+    return channels == 3 ? rgbToXrgb : rgbaToPremultipliedArgb;
+}
+
+static void addImplementationRows(const char* name, const QList<int>& values)
+{
+    static const char* const names[] = { "generic", "sse2", "avx2" };
+    for (int implementation = 0; implementation < 3; ++implementation) {
+        for (int channels = 3; channels <= 4; ++channels) {
+            Q_FOREACH(int value, values) {
+                const QByteArray row = QString("%1-%2ch-%3%4")
+                    .arg(names[implementation]).arg(channels).arg(name).arg(value).toAscii();
+                QTest::newRow(row.constData())
+                    << PixelConversion::Implementation(implementation) << channels << value;
+            }
+        }
+    }
+}
+
+void PixelConversionTest::initTestCase()
+{
+    qsrand(42);
+}
+
+void PixelConversionTest::testConvert_data()
+{
+    QTest::addColumn<PixelConversion::Implementation>("implementation");
+    QTest::addColumn<int>("channels");
+    QTest::addColumn<int>("count");
+
+    // Below one vector, around the vector sizes and their multiples, and
+    // large enough to go through the main loops several times
+    QList<int> counts;
+    for (int count = 0; count <= 20; ++count) {
+        counts << count;
+    }
+    counts << 31 << 32 << 33 << 63 << 64 << 65 << 257;
+    addImplementationRows("count", counts);
+}
+
+void PixelConversionTest::testConvert()
+{
+    QFETCH(PixelConversion::Implementation, implementation);
+    QFETCH(int, channels);
+    QFETCH(int, count);
+    const PixelConversion::ConvertFunction convert = convertFunction(implementation, channels);
+    if (!convert) {
+        QSKIP("Implementation not supported on this CPU", SkipSingle);
+    }
+    const PixelConversion::ConvertFunction reference = convertFunction(PixelConversion::GenericImplementation, channels);
+
+    // Start at an odd offset so that the source is not aligned, and do not
+    // leave room after the last pixel so that overreads can be caught by
+    // memory checkers
+    const QByteArray bytes = randomBytes(count * channels + 1);
+    const uchar* src = reinterpret_cast<const uchar*>(bytes.constData()) + 1;
+
+    QVector<QRgb> expected(count + 1, GUARD);
+    reference(expected.data(), src, count);
+    QVector<QRgb> result(count + 1, GUARD);
+    convert(result.data(), src, count);
+    QCOMPARE(result, expected);
+}
+
+void PixelConversionTest::testScaleDown_data()
+{
+    QTest::addColumn<PixelConversion::Implementation>("implementation");
+    QTest::addColumn<int>("channels");
+    QTest::addColumn<int>("width");
+
+    addImplementationRows("width", QList<int>() << 5 << 7 << 9 << 15 << 17 << 33 << 131);
+}
+
+/**
+ * Straightforward version of PixelConversion::scaleDown(): converts the whole
+ * image, then averages each box
+ */
+static QImage referenceScaleDown(const QSize& size, const uchar* src, int width, int height, int lineCount, int rowStride, int channels)
+{
+    const PixelConversion::ConvertFunction convert = convertFunction(PixelConversion::GenericImplementation, channels);
+    QVector<QRgb> pixels(width * lineCount);
+    for (int y = 0; y < lineCount; ++y) {
+        convert(pixels.data() + y * width, src + y * rowStride, width);
+    }
+
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    for (int dy = 0; dy < size.height(); ++dy) {
+        for (int dx = 0; dx < size.width(); ++dx) {
+            uint alpha = 0, red = 0, green = 0, blue = 0, count = 0;
+            for (int y = 0; y < lineCount; ++y) {
+                if (y * size.height() / height != dy) {
+                    continue;
+                }
+                for (int x = 0; x < width; ++x) {
+                    if (x * size.width() / width != dx) {
+                        continue;
+                    }
+                    const QRgb pixel = pixels.at(y * width + x);
+                    alpha += qAlpha(pixel);
+                    red += qRed(pixel);
+                    green += qGreen(pixel);
+                    blue += qBlue(pixel);
+                    ++count;
+                }
+            }
+            QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(dy));
+            if (count == 0) {
+                line[dx] = 0;
+            } else {
+                line[dx] = qRgba((red + count / 2) / count,
+                    (green + count / 2) / count,
+                    (blue + count / 2) / count,
+                    (alpha + count / 2) / count);
+            }
+        }
+    }
+    return image;
+}
+
+void PixelConversionTest::testScaleDown()
+{
+    QFETCH(PixelConversion::Implementation, implementation);
+    QFETCH(int, channels);
+    QFETCH(int, width);
+    const PixelConversion::ConvertFunction convert = convertFunction(implementation, channels);
+    if (!convert) {
+        QSKIP("Implementation not supported on this CPU", SkipSingle);
+    }
+
+    const int height = width + 2;
+    // Packed lines, then padded lines
+    for (int padding = 0; padding <= 3; padding += 3) {
+        const int rowStride = width * channels + padding;
+        const QByteArray bytes = randomBytes(rowStride * height);
+        const uchar* src = reinterpret_cast<const uchar*>(bytes.constData());
+        const QSize size = QSize(width, height).scaled(4, 4, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+
+        // Complete, then truncated data
+        for (int lineCount = height; lineCount >= height / 2; lineCount -= height - height / 2) {
+            QImage image(size, QImage::Format_ARGB32_Premultiplied);
+            PixelConversion::scaleDown(&image, src, width, height, lineCount, rowStride, convert);
+            const QImage expected = referenceScaleDown(size, src, width, height, lineCount, rowStride, channels);
+            for (int y = 0; y < size.height(); ++y) {
+                QVERIFY2(memcmp(image.constScanLine(y), expected.constScanLine(y), size.width() * sizeof(QRgb)) == 0,
+                    qPrintable(QString("padding: %1 lineCount: %2 line: %3").arg(padding).arg(lineCount).arg(y)));
+            }
+        }
+    }
+}
+
+#include "pixelconversiontest.moc"